@@ -4,9 +4,13 @@
 #include "create_network.h"
 #include "random.h"
 #include <algorithm>
+#include <chrono>
 #include <iostream>
 #include <memory>
+#include <pthread.h>
+#include <sched.h>
 #include <string>
+#include <thread>
 #include <torch/cuda.h>
 #include <utility>
 
@@ -17,8 +21,12 @@ using namespace utils;
 
 int ThreadSharedData::getAvailableActorIndex()
 {
+    // only hand out actors of the cohort running CPU jobs in this round
     std::lock_guard lock(mutex_);
-    return (actor_index_ < static_cast<int>(actors_.size()) ? actor_index_++ : actors_.size());
+    if (actor_index_ >= static_cast<int>(actors_.size())) { return actors_.size(); }
+    int actor_index = actor_index_;
+    actor_index_ += num_cohorts_;
+    return actor_index;
 }
 
 void ThreadSharedData::outputGame(const std::shared_ptr<BaseActor>& actor)
@@ -63,6 +71,39 @@ std::pair<int, int> ThreadSharedData::calculateTrainingDataRange(const std::shar
     return {data_start, data_end};
 }
 
+bool ThreadSharedData::forwardNetwork(int network_id)
+{
+    std::shared_ptr<Network>& network = networks_[network_id];
+    // release the outputs of the previous batch before running the next one, so that the network can reuse their buffer
+    // the outputs are kept if there is no batch, they may not be consumed yet (e.g., when all networks are flushed before swapping models)
+    if (network->getNetworkTypeName() == "alphazero") {
+        std::shared_ptr<AlphaZeroNetwork> az_network = std::static_pointer_cast<AlphaZeroNetwork>(network);
+        if (az_network->getBatchSize() > 0) {
+            network_outputs_[network_id].clear();
+            network_outputs_[network_id] = az_network->forward();
+            return true;
+        }
+    } else if (network->getNetworkTypeName() == "muzero" || network->getNetworkTypeName() == "muzero_atari") {
+        std::shared_ptr<MuZeroNetwork> muzero_network = std::static_pointer_cast<MuZeroNetwork>(network);
+        if (muzero_network->getInitialInputBatchSize() > 0) {
+            network_outputs_[network_id].clear();
+            network_outputs_[network_id] = muzero_network->initialInference();
+            return true;
+        } else if (muzero_network->getRecurrentInputBatchSize() > 0) {
+            network_outputs_[network_id].clear();
+            network_outputs_[network_id] = muzero_network->recurrentInference();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadSharedData::addBusyTime(bool is_gpu_job, double busy_time)
+{
+    std::lock_guard lock(mutex_);
+    (is_gpu_job ? gpu_busy_time_ : cpu_busy_time_) += busy_time;
+}
+
 void SlaveThread::initialize()
 {
     int seed = config::program_auto_seed ? std::random_device()() : config::program_seed + id_;
@@ -71,11 +112,16 @@ void SlaveThread::initialize()
 
 void SlaveThread::runJob()
 {
-    if (getSharedData()->do_cpu_job_) {
-        while (doCPUJob()) {}
+    // without pipelining, all threads alternate between CPU and GPU rounds
+    // with pipelining, the first getNumNetworksPerCohort() threads are dedicated to inference of the GPU cohort
+    bool is_gpu_job = (getSharedData()->num_cohorts_ == 1 ? !getSharedData()->do_cpu_job_ : id_ < getSharedData()->getNumNetworksPerCohort());
+    boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
+    if (is_gpu_job) {
+        if (!doGPUJob()) { return; }
     } else {
-        doGPUJob();
+        while (doCPUJob()) {}
     }
+    getSharedData()->addBusyTime(is_gpu_job, (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1e6);
 }
 
 bool SlaveThread::doCPUJob()
@@ -84,7 +130,7 @@ bool SlaveThread::doCPUJob()
     if (actor_id >= getSharedData()->actors_.size()) { return false; }
 
     std::shared_ptr<BaseActor>& actor = getSharedData()->actors_[actor_id];
-    int network_id = actor_id % getSharedData()->networks_.size();
+    int network_id = getSharedData()->getNetworkIndex(actor_id);
     int network_output_id = actor->getNNEvaluationBatchIndex();
     if (network_output_id >= 0) {
         assert(network_output_id < static_cast<int>(getSharedData()->network_outputs_[network_id].size()));
@@ -92,25 +138,35 @@ bool SlaveThread::doCPUJob()
         if (actor->isSearchDone()) { handleSearchDone(actor_id); }
     }
     actor->beforeNNEvaluation();
+
+    // the search can also be finished by leaves from the evaluation cache without waiting for the network
+    while (actor->getNNEvaluationBatchIndex() < 0 && actor->isSearchDone()) {
+        handleSearchDone(actor_id);
+        actor->beforeNNEvaluation();
+    }
     return true;
 }
 
-void SlaveThread::doGPUJob()
+bool SlaveThread::doGPUJob()
 {
-    if (id_ >= static_cast<int>(getSharedData()->networks_.size())) { return; }
+    int num_networks_per_cohort = getSharedData()->getNumNetworksPerCohort();
+    if (id_ >= num_networks_per_cohort) { return false; }
 
-    std::shared_ptr<Network>& network = getSharedData()->networks_[id_];
-    if (network->getNetworkTypeName() == "alphazero") {
-        std::shared_ptr<AlphaZeroNetwork> az_network = std::static_pointer_cast<AlphaZeroNetwork>(network);
-        if (az_network->getBatchSize() > 0) { getSharedData()->network_outputs_[id_] = az_network->forward(); }
-    } else if (network->getNetworkTypeName() == "muzero" || network->getNetworkTypeName() == "muzero_atari") {
-        std::shared_ptr<MuZeroNetwork> muzero_network = std::static_pointer_cast<MuZeroNetwork>(network);
-        if (muzero_network->getInitialInputBatchSize() > 0) {
-            getSharedData()->network_outputs_[id_] = std::static_pointer_cast<MuZeroNetwork>(network)->initialInference();
-        } else if (muzero_network->getRecurrentInputBatchSize() > 0) {
-            getSharedData()->network_outputs_[id_] = std::static_pointer_cast<MuZeroNetwork>(network)->recurrentInference();
-        }
-    }
+    if (config::zero_actor_pin_cpu_networks && config::nn_server_name.empty() && !is_cpu_affinity_set_ && getSharedData()->networks_[id_]->getGPUID() == -1) { setCPUNetworkAffinity(num_networks_per_cohort); }
+    return getSharedData()->forwardNetwork(getSharedData()->gpu_cohort_ * num_networks_per_cohort + id_);
+}
+
+void SlaveThread::setCPUNetworkAffinity(int num_networks)
+{
+    // split the cores evenly among the CPU networks, the intra-op threads of the forward inherit the affinity of this thread
+    int num_cores = std::max(1, static_cast<int>(std::thread::hardware_concurrency()));
+    int first_core = id_ * num_cores / num_networks;
+    int last_core = std::max(first_core + 1, (id_ + 1) * num_cores / num_networks);
+    cpu_set_t cpu_set;
+    CPU_ZERO(&cpu_set);
+    for (int core = first_core; core < std::min(last_core, num_cores); ++core) { CPU_SET(core, &cpu_set); }
+    if (pthread_setaffinity_np(pthread_self(), sizeof(cpu_set), &cpu_set) != 0) { std::cerr << "[warning] failed to pin the inference thread " << id_ << " to cores " << first_core << "-" << last_core - 1 << std::endl; }
+    is_cpu_affinity_set_ = true;
 }
 
 void SlaveThread::handleSearchDone(int actor_id)
@@ -138,23 +194,32 @@ void ActorGroup::run()
     initialize();
     while (true) {
         handleCommand();
+        swapShadowNetworks();
 
         if (!running_) { continue; }
-        getSharedData()->actor_index_ = 0;
+        startNextRound();
         for (auto& t : slave_threads_) { t->start(); }
         for (auto& t : slave_threads_) { t->finish(); }
         getSharedData()->do_cpu_job_ = !getSharedData()->do_cpu_job_;
+        reportUtilization();
     }
 }
 
 void ActorGroup::initialize()
 {
-    int num_threads = std::max(static_cast<int>(torch::cuda::device_count()), config::zero_num_threads);
+    assert(config::zero_actor_num_pipeline_cohorts >= 1 && config::zero_actor_num_pipeline_cohorts <= config::zero_num_parallel_games);
+    getSharedData()->num_cohorts_ = config::zero_actor_num_pipeline_cohorts;
+    int num_networks = calculateNumNetworksPerCohort();
+    int num_threads = (getSharedData()->num_cohorts_ == 1 ? std::max(num_networks, config::zero_num_threads) : num_networks + config::zero_num_threads);
     createSlaveThreads(num_threads);
     createNeuralNetworks();
     createActors();
     running_ = false;
+    num_rounds_ = 0;
     getSharedData()->do_cpu_job_ = true;
+    getSharedData()->cpu_cohort_ = getSharedData()->gpu_cohort_ = 0;
+    getSharedData()->num_cpu_threads_ = (getSharedData()->num_cohorts_ == 1 ? num_threads : config::zero_num_threads);
+    resetUtilization();
 
     // create one thread to handle I/O
     commands_.clear();
@@ -167,22 +232,41 @@ void ActorGroup::initialize()
 
 void ActorGroup::createNeuralNetworks()
 {
-    int num_networks = std::min(static_cast<int>(torch::cuda::device_count()), config::zero_num_parallel_games);
+    int num_networks = calculateNumNetworksPerCohort();
     assert(num_networks > 0);
-    getSharedData()->networks_.resize(num_networks);
-    getSharedData()->network_outputs_.resize(num_networks);
-    for (int gpu_id = 0; gpu_id < num_networks; ++gpu_id) {
-        getSharedData()->networks_[gpu_id] = createNetwork(config::nn_file_name, gpu_id);
+    bool use_gpu = (torch::cuda::device_count() > 0);
+    CPUInferenceOptions cpu_inference_options = createCPUInferenceOptions(num_networks);
+    if (!use_gpu && config::nn_cpu_num_inter_op_threads > 0) { torch::set_num_interop_threads(config::nn_cpu_num_inter_op_threads); }
+    getSharedData()->networks_.resize(getSharedData()->num_cohorts_ * num_networks);
+    getSharedData()->network_outputs_.resize(getSharedData()->num_cohorts_ * num_networks);
+    max_batch_size_ = (config::zero_num_parallel_games + getSharedData()->num_cohorts_ * num_networks - 1) / (getSharedData()->num_cohorts_ * num_networks);
+    for (int cohort = 0; cohort < getSharedData()->num_cohorts_; ++cohort) {
+        for (int id = 0; id < num_networks; ++id) {
+            if (config::nn_server_name.empty()) {
+                getSharedData()->networks_[cohort * num_networks + id] = createNetwork(config::nn_file_name, (use_gpu ? id : -1), max_batch_size_, cpu_inference_options);
+            } else {
+                getSharedData()->networks_[cohort * num_networks + id] = createNNClientNetwork(config::nn_server_name, config::nn_file_name, max_batch_size_);
+            }
+        }
     }
 }
 
+int ActorGroup::calculateNumNetworksPerCohort()
+{
+    // one network per GPU, or zero_actor_num_cpu_networks networks on machines without GPUs
+    // with an nn_server, the server owns the devices and each cohort sends its batch through one slot
+    if (!config::nn_server_name.empty()) { return 1; }
+    int num_devices = (torch::cuda::device_count() > 0 ? static_cast<int>(torch::cuda::device_count()) : config::zero_actor_num_cpu_networks);
+    return std::min(num_devices, (config::zero_num_parallel_games + getSharedData()->num_cohorts_ - 1) / getSharedData()->num_cohorts_);
+}
+
 void ActorGroup::createActors()
 {
     assert(getSharedData()->networks_.size() > 0);
     std::shared_ptr<Network>& network = getSharedData()->networks_[0];
     uint64_t tree_node_size = static_cast<uint64_t>(config::actor_num_simulation + 1) * network->getActionSize();
     for (int i = 0; i < config::zero_num_parallel_games; ++i) {
-        getSharedData()->actors_.emplace_back(createActor(tree_node_size, getSharedData()->networks_[i % getSharedData()->networks_.size()]));
+        getSharedData()->actors_.emplace_back(createActor(tree_node_size, getSharedData()->networks_[getSharedData()->getNetworkIndex(i)]));
     }
 }
 
@@ -199,7 +283,8 @@ void ActorGroup::handleIO()
 
 void ActorGroup::handleCommand()
 {
-    if (commands_.empty() || !getSharedData()->do_cpu_job_) { return; }
+    // without pipelining, commands are only handled before CPU rounds when no batch is in flight
+    if (commands_.empty() || (getSharedData()->num_cohorts_ == 1 && !getSharedData()->do_cpu_job_)) { return; }
 
     std::lock_guard lock(getSharedData()->mutex_);
     while (!commands_.empty()) {
@@ -228,8 +313,18 @@ void ActorGroup::handleCommand(const std::string& command_prefix, const std::str
         std::cerr << "[command] " << command << std::endl;
         std::vector<std::string> args = utils::stringToVector(command);
         assert(args.size() == 2);
-        config::nn_file_name = args[1];
-        for (auto& network : getSharedData()->networks_) { network->loadModel(config::nn_file_name, network->getGPUID()); }
+        if (config::nn_server_name.empty()) {
+            loadShadowNetworks(args[1]);
+        } else {
+            // the nn_server loads the model in the background itself, the client networks report the model actually running their batches
+            config::nn_file_name = args[1];
+            for (size_t network_id = 0; network_id < getSharedData()->networks_.size(); ++network_id) {
+                // finish the in-flight batch before requesting the model, its outputs are consumed in the next CPU round of the cohort
+                getSharedData()->forwardNetwork(network_id);
+                std::shared_ptr<Network>& network = getSharedData()->networks_[network_id];
+                network->loadModel(config::nn_file_name, network->getGPUID());
+            }
+        }
     } else if (command_prefix == "update_config") {
         std::cerr << "[command] " << command << std::endl;
         assert(command.find(" ") != std::string::npos);
@@ -242,6 +337,7 @@ void ActorGroup::handleCommand(const std::string& command_prefix, const std::str
     } else if (command_prefix == "start") {
         std::cerr << "[command] " << command << std::endl;
         running_ = true;
+        resetUtilization();
     } else if (command_prefix == "stop") {
         std::cerr << "[command] " << command << std::endl;
         running_ = false;
@@ -251,4 +347,83 @@ void ActorGroup::handleCommand(const std::string& command_prefix, const std::str
     }
 }
 
+void ActorGroup::loadShadowNetworks(const std::string& nn_file_name)
+{
+    // a newer model supersedes the one still loading, which has to finish first since its thread cannot be interrupted
+    if (shadow_networks_.valid()) { shadow_networks_.wait(); }
+
+    std::vector<std::pair<int, CPUInferenceOptions>> network_settings;
+    for (const auto& network : getSharedData()->networks_) { network_settings.emplace_back(network->getGPUID(), network->getCPUInferenceOptions()); }
+    int max_batch_size = max_batch_size_;
+    shadow_nn_file_name_ = nn_file_name;
+    shadow_load_start_ptime_ = utils::TimeSystem::getLocalTime();
+    shadow_networks_ = std::async(std::launch::async, [nn_file_name, network_settings, max_batch_size]() {
+        std::vector<std::shared_ptr<Network>> networks;
+        for (const auto& setting : network_settings) { networks.push_back(createNetwork(nn_file_name, setting.first, max_batch_size, setting.second)); }
+        return networks;
+    });
+}
+
+void ActorGroup::swapShadowNetworks()
+{
+    // swap between rounds when the shadow networks are ready, without pipelining only before CPU rounds like commands
+    if (!shadow_networks_.valid() || shadow_networks_.wait_for(std::chrono::seconds(0)) != std::future_status::ready) { return; }
+    if (getSharedData()->num_cohorts_ == 1 && !getSharedData()->do_cpu_job_) { return; }
+
+    double load_time = (utils::TimeSystem::getLocalTime() - shadow_load_start_ptime_).total_microseconds() / 1e6;
+    std::vector<std::shared_ptr<Network>> shadow_networks = shadow_networks_.get();
+    boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
+    for (size_t network_id = 0; network_id < getSharedData()->networks_.size(); ++network_id) {
+        // finish the in-flight batch with the old model before swapping, its outputs are consumed in the next CPU round of the cohort
+        getSharedData()->forwardNetwork(network_id);
+        getSharedData()->networks_[network_id]->swapModel(*shadow_networks[network_id]);
+    }
+    shadow_networks.clear(); // release the old models
+    config::nn_file_name = shadow_nn_file_name_; // the games searched so far used the old models
+    double stall_time = (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1e3;
+    std::cerr << utils::TimeSystem::getTimeString("[Y/m/d H:i:s.f] ")
+              << "swap in model " << getSharedData()->networks_[0]->getNetworkFileName()
+              << ", loaded in background: " << load_time << " s"
+              << ", stall: " << stall_time << " ms" << std::endl;
+}
+
+void ActorGroup::startNextRound()
+{
+    // with pipelining, the GPU cohort runs inference on the batch prepared in its last CPU round,
+    // while the CPU cohort consumes the outputs of its last inference and prepares its next batch
+    std::shared_ptr<ThreadSharedData> shared_data = getSharedData();
+    if (shared_data->num_cohorts_ > 1) {
+        shared_data->gpu_cohort_ = num_rounds_ % shared_data->num_cohorts_;
+        shared_data->cpu_cohort_ = (num_rounds_ + 1) % shared_data->num_cohorts_;
+    }
+    shared_data->actor_index_ = shared_data->cpu_cohort_;
+    ++num_rounds_;
+}
+
+void ActorGroup::resetUtilization()
+{
+    getSharedData()->cpu_busy_time_ = getSharedData()->gpu_busy_time_ = 0.0;
+    report_start_round_ = num_rounds_;
+    report_start_ptime_ = utils::TimeSystem::getLocalTime();
+}
+
+void ActorGroup::reportUtilization()
+{
+    if (config::zero_actor_pipeline_report_interval <= 0) { return; }
+
+    double elapsed_time = (utils::TimeSystem::getLocalTime() - report_start_ptime_).total_microseconds() / 1e6;
+    if (elapsed_time < config::zero_actor_pipeline_report_interval) { return; }
+
+    std::shared_ptr<ThreadSharedData> shared_data = getSharedData();
+    std::cerr << utils::TimeSystem::getTimeString("[Y/m/d H:i:s.f] ")
+              << "actor pipeline: " << shared_data->num_cohorts_ << " cohort(s)"
+              << ", rounds/s: " << (num_rounds_ - report_start_round_) / elapsed_time
+              << ", CPU utilization: " << 100.0f * shared_data->cpu_busy_time_ / (shared_data->num_cpu_threads_ * elapsed_time) << "%"
+              << ", GPU utilization: " << 100.0f * shared_data->gpu_busy_time_ / (shared_data->getNumNetworksPerCohort() * elapsed_time) << "%"
+              << ", tree memory: " << TreeNodeBlockPool::getInstance().getUsedBytes() / (1 << 20) << " MB"
+              << " (peak: " << TreeNodeBlockPool::getInstance().getPeakUsedBytes() / (1 << 20) << " MB"
+              << ", allocated: " << TreeNodeBlockPool::getInstance().getAllocatedBytes() / (1 << 20) << " MB)" << std::endl;
+    resetUtilization();
+}
+
 } // namespace minizero::actor
@@ -3,7 +3,9 @@
 #include "base_actor.h"
 #include "network.h"
 #include "paralleler.h"
+#include "time_system.h"
 #include <deque>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <string>
@@ -18,9 +20,21 @@ public:
     int getAvailableActorIndex();
     void outputGame(const std::shared_ptr<BaseActor>& actor);
     std::pair<int, int> calculateTrainingDataRange(const std::shared_ptr<BaseActor>& actor);
+    bool forwardNetwork(int network_id);
+    void addBusyTime(bool is_gpu_job, double busy_time);
+
+    // actors are split into cohorts, actor i belongs to cohort i % num_cohorts_ and each cohort owns one network per GPU
+    inline int getNumNetworksPerCohort() const { return networks_.size() / num_cohorts_; }
+    inline int getNetworkIndex(int actor_id) const { return (actor_id % num_cohorts_) * getNumNetworksPerCohort() + (actor_id / num_cohorts_) % getNumNetworksPerCohort(); }
 
     bool do_cpu_job_;
     int actor_index_;
+    int num_cohorts_;
+    int cpu_cohort_;
+    int gpu_cohort_;
+    int num_cpu_threads_;
+    double cpu_busy_time_;
+    double gpu_busy_time_;
     std::mutex mutex_;
     std::vector<std::shared_ptr<BaseActor>> actors_;
     std::vector<std::shared_ptr<network::Network>> networks_;
@@ -30,7 +44,8 @@ public:
 class SlaveThread : public utils::BaseSlaveThread {
 public:
     SlaveThread(int id, std::shared_ptr<utils::BaseSharedData> shared_data)
-        : BaseSlaveThread(id, shared_data) {}
+        : BaseSlaveThread(id, shared_data),
+          is_cpu_affinity_set_(false) {}
 
     void initialize() override;
     void runJob() override;
@@ -38,9 +53,12 @@ public:
 
 protected:
     virtual bool doCPUJob();
-    virtual void doGPUJob();
+    virtual bool doGPUJob();
     virtual void handleSearchDone(int actor_id);
+    void setCPUNetworkAffinity(int num_networks);
     inline std::shared_ptr<ThreadSharedData> getSharedData() { return std::static_pointer_cast<ThreadSharedData>(shared_data_); }
+
+    bool is_cpu_affinity_set_;
 };
 
 class ActorGroup : public utils::BaseParalleler {
@@ -53,18 +71,33 @@ public:
 
 protected:
     virtual void createNeuralNetworks();
+    virtual int calculateNumNetworksPerCohort();
     virtual void createActors();
     virtual void handleIO();
     virtual void handleCommand();
     virtual void handleCommand(const std::string& command_prefix, const std::string& command);
+    virtual void loadShadowNetworks(const std::string& nn_file_name);
+    virtual void swapShadowNetworks();
+    virtual void startNextRound();
+    virtual void resetUtilization();
+    virtual void reportUtilization();
 
     void createSharedData() override { shared_data_ = std::make_shared<ThreadSharedData>(); }
     std::shared_ptr<utils::BaseSlaveThread> newSlaveThread(int id) override { return std::make_shared<SlaveThread>(id, shared_data_); }
     inline std::shared_ptr<ThreadSharedData> getSharedData() { return std::static_pointer_cast<ThreadSharedData>(shared_data_); }
 
     bool running_;
+    int max_batch_size_; // the max batch size of each network
+    uint64_t num_rounds_;
+    uint64_t report_start_round_;
+    boost::posix_time::ptime report_start_ptime_;
     std::deque<std::string> commands_;
     std::unordered_set<std::string> ignored_commands_;
+
+    // the networks of the next model, loaded on a background thread and swapped in between rounds
+    std::future<std::vector<std::shared_ptr<network::Network>>> shadow_networks_;
+    std::string shadow_nn_file_name_; // becomes config::nn_file_name once the shadow networks are swapped in
+    boost::posix_time::ptime shadow_load_start_ptime_;
 };
 
 } // namespace minizero::actor
@@ -9,6 +9,7 @@ void BaseActor::reset()
 {
     env_.reset();
     action_info_history_.clear();
+    network_file_names_.clear();
     resetSearch();
 }
 
@@ -25,6 +26,7 @@ bool BaseActor::act(const Action& action)
     if (can_act) {
         action_info_history_.resize(env_.getActionHistory().size());
         action_info_history_.back() = getActionInfo();
+        recordNetworkFileName();
     }
     return can_act;
 }
@@ -35,6 +37,7 @@ bool BaseActor::act(const std::vector<std::string>& action_string_args)
     if (can_act) {
         action_info_history_.resize(env_.getActionHistory().size());
         action_info_history_.back() = getActionInfo();
+        recordNetworkFileName();
     }
     return can_act;
 }
@@ -43,7 +46,11 @@ std::string BaseActor::getRecord(const std::unordered_map<std::string, std::stri
 {
     EnvironmentLoader env_loader;
     env_loader.loadFromEnvironment(env_, action_info_history_);
-    env_loader.addTag("EV", config::nn_file_name.substr(config::nn_file_name.find_last_of('/') + 1));
+
+    // the models playing the game in order, separated by ','
+    std::string network_file_names;
+    for (const auto& network_file_name : network_file_names_) { network_file_names += (network_file_names.empty() ? "" : ",") + network_file_name; }
+    env_loader.addTag("EV", (network_file_names.empty() ? config::nn_file_name.substr(config::nn_file_name.find_last_of('/') + 1) : network_file_names));
 
     // if the game is not ended, then treat the game as a resign game, where the next player is the lose side
     if (!isEnvTerminal()) {
@@ -56,6 +63,21 @@ std::string BaseActor::getRecord(const std::unordered_map<std::string, std::stri
     return env_loader.toString();
 }
 
+std::string BaseActor::getNetworkFileName() const
+{
+    return config::nn_file_name;
+}
+
+void BaseActor::recordNetworkFileName()
+{
+    // tag the first move played by each model after the first one, where the model is swapped
+    std::string network_file_name = getNetworkFileName();
+    network_file_name = network_file_name.substr(network_file_name.find_last_of('/') + 1);
+    if (!network_file_names_.empty() && network_file_names_.back() == network_file_name) { return; }
+    if (!network_file_names_.empty()) { action_info_history_.back().push_back({"EV", network_file_name}); }
+    network_file_names_.push_back(network_file_name);
+}
+
 std::vector<std::pair<std::string, std::string>> BaseActor::getActionInfo() const
 {
     std::vector<std::pair<std::string, std::string>> action_info;
@@ -23,6 +23,7 @@ public:
     bool act(const Action& action);
     bool act(const std::vector<std::string>& action_string_args);
     virtual std::string getRecord(const std::unordered_map<std::string, std::string>& tags = {}) const;
+    virtual std::string getNetworkFileName() const;
 
     inline bool isEnvTerminal() const { return env_.isTerminal(); }
     inline const float getEvalScore() const { return env_.getEvalScore(); }
@@ -47,11 +48,13 @@ protected:
     virtual std::string getMCTSPolicy() const = 0;
     virtual std::string getMCTSValue() const = 0;
     virtual std::string getEnvReward() const = 0;
+    void recordNetworkFileName();
 
     int nn_evaluation_batch_id_;
     Environment env_;
     std::shared_ptr<Search> search_;
     std::vector<std::vector<std::pair<std::string, std::string>>> action_info_history_;
+    std::vector<std::string> network_file_names_; // the models playing the moves in order, a model can be swapped in the middle of a game
 };
 
 } // namespace minizero::actor
@@ -3,6 +3,7 @@
 #include "base_actor.h"
 #include "configuration.h"
 #include "zero_actor.h"
+#include <algorithm>
 #include <memory>
 
 namespace minizero::actor {
@@ -18,4 +19,15 @@ inline std::shared_ptr<actor::BaseActor> createActor(uint64_t tree_node_size, co
     return nullptr;
 }
 
+// the CPU inference settings from the configuration, where the intra-op threads are shared by all CPU networks
+inline network::CPUInferenceOptions createCPUInferenceOptions(int num_networks)
+{
+    assert(num_networks > 0);
+    network::CPUInferenceOptions cpu_inference_options;
+    cpu_inference_options.optimize_for_inference_ = config::nn_cpu_optimize_for_inference;
+    cpu_inference_options.quantize_int8_ = config::nn_cpu_quantize_int8;
+    cpu_inference_options.num_intra_op_threads_ = (config::nn_cpu_num_intra_op_threads > 0 ? config::nn_cpu_num_intra_op_threads : std::max(1, config::zero_num_threads / num_networks));
+    return cpu_inference_options;
+}
+
 } // namespace minizero::actor
@@ -13,17 +13,17 @@ std::string GumbelZero::getMCTSPolicy(const std::shared_ptr<MCTS>& mcts) const
     for (int i = 0; i < mcts->getRootNode()->getNumChildren(); ++i) {
         MCTSNode* child = mcts->getRootNode()->getChild(i);
         if (child->getCount() == 0) { continue; }
-        float value = child->getNormalizedMean(mcts->getTreeValueBound());
+        float value = mcts->getNormalizedMean(child);
         pi_sum += child->getPolicy();
         q_sum += child->getPolicy() * value;
     }
     float value_pi = mcts->getRootNode()->getValue();
     if (config::actor_mcts_value_rescale) {
-        if (mcts->getTreeValueBound().size() < 2) {
+        if (!mcts->getTreeValueBound().hasBound()) {
             value_pi = 1.0f;
         } else {
-            const float value_lower_bound = mcts->getTreeValueBound().begin()->first;
-            const float value_upper_bound = mcts->getTreeValueBound().rbegin()->first;
+            const float value_lower_bound = mcts->getTreeValueBound().getLowerBound();
+            const float value_upper_bound = mcts->getTreeValueBound().getUpperBound();
             value_pi = (value_pi - value_lower_bound) / (value_upper_bound - value_lower_bound);
             value_pi = fmin(1, fmax(-1, 2 * value_pi - 1));
         }
@@ -38,7 +38,7 @@ std::string GumbelZero::getMCTSPolicy(const std::shared_ptr<MCTS>& mcts) const
     for (int i = 0; i < mcts->getRootNode()->getNumChildren(); ++i) { max_child_count = fmax(max_child_count, mcts->getRootNode()->getChild(i)->getCount()); }
     for (int i = 0; i < mcts->getRootNode()->getNumChildren(); ++i) {
         MCTSNode* child = mcts->getRootNode()->getChild(i);
-        float value = (child->getCount() == 0 ? non_visited_node_value : child->getNormalizedMean(mcts->getTreeValueBound()));
+        float value = (child->getCount() == 0 ? non_visited_node_value : mcts->getNormalizedMean(child));
         float logit_without_noise = child->getPolicyLogit() - child->getPolicyNoise();
         float score = logit_without_noise + (config::actor_gumbel_sigma_visit_c + max_child_count) * config::actor_gumbel_sigma_scale_c * value;
         new_logits.insert({child->getAction().getActionID(), score});
@@ -61,7 +61,7 @@ MCTSNode* GumbelZero::decideActionNode(const std::shared_ptr<MCTS>& mcts)
 {
     if (config::actor_select_action_by_count) {
         assert(candidates_.size() > 0);
-        sortCandidatesByScore(mcts);
+        selectTopCandidatesByScore(mcts, 1);
         return candidates_[0];
     } else if (config::actor_select_action_by_softmax_count) {
         return mcts->selectChildBySoftmaxCount(mcts->getRootNode(), config::actor_select_action_softmax_temperature);
@@ -77,63 +77,91 @@ std::vector<MCTSNode*> GumbelZero::selection(const std::shared_ptr<MCTS>& mcts)
     if (mcts->getNumSimulation() == 0) {
         node_path = mcts->select();
     } else {
-        assert(candidates_.size() > 0);
-        sort(candidates_.begin(), candidates_.end(), [](const MCTSNode* lhs, const MCTSNode* rhs) {
-            return (lhs->getCount() < rhs->getCount() || (lhs->getCount() == rhs->getCount() && lhs->getPolicyLogit() > rhs->getPolicyLogit()));
-        });
-        node_path = mcts->selectFromNode(candidates_[0]);
+        // candidates are visited in rounds ordered by policy logit, i.e., the one with the fewest visits and then the largest policy logit
+        assert(candidates_.size() > 0 && phase_index_ < phases_.size());
+        const Phase& phase = phases_[phase_index_];
+        assert(getNumPhaseSimulationsLeft() > 0);
+        node_path = mcts->selectFromNode(candidates_[(next_simulation_++ - phase.first_simulation_) % phase.num_candidates_]);
         node_path.insert(node_path.begin(), mcts->getRootNode());
     }
     return node_path;
 }
 
+void GumbelZero::cancelSelection(const std::shared_ptr<MCTS>& mcts)
+{
+    // give back the scheduled visit of a selection that is not evaluated, e.g., a collision in a batch
+    if (mcts->getNumSimulation() > 0) { --next_simulation_; }
+}
+
 void GumbelZero::sequentialHalving(const std::shared_ptr<MCTS>& mcts)
 {
     if (mcts->getNumSimulation() == 1) {
         // collect candidates
         candidates_.clear();
         for (int i = 0; i < mcts->getRootNode()->getNumChildren(); ++i) { candidates_.push_back(mcts->getRootNode()->getChild(i)); }
-        sort(candidates_.begin(), candidates_.end(), [](const MCTSNode* lhs, const MCTSNode* rhs) { return lhs->getPolicyLogit() > rhs->getPolicyLogit(); });
+        sortCandidatesByPolicyLogit();
         if (static_cast<int>(candidates_.size()) > config::actor_gumbel_sample_size) { candidates_.resize(config::actor_gumbel_sample_size); }
-        sample_size_ = config::actor_gumbel_sample_size;
-        simulation_budget_ = std::max(1.0, std::floor(config::actor_num_simulation / (std::log2(config::actor_gumbel_sample_size) * sample_size_)));
-    } else {
-        bool all_candidates_reach_budget = true;
-        for (auto node : candidates_) {
-            if (node->getCount() >= simulation_budget_) { continue; }
-            all_candidates_reach_budget = false;
-            break;
-        }
-
-        if (all_candidates_reach_budget) {
-            int next_budget = std::floor(config::actor_num_simulation / (std::log2(config::actor_gumbel_sample_size) * sample_size_ / 2));
-            if (next_budget > 0 && sample_size_ > 2) {
-                sample_size_ /= 2;
-                assert(sample_size_ > 0);
-                sortCandidatesByScore(mcts);
-                if (static_cast<int>(candidates_.size()) > sample_size_) { candidates_.resize(sample_size_); }
-                simulation_budget_ = candidates_[0]->getCount() + next_budget;
-            }
-        }
+        schedulePhases(candidates_.size());
+    } else if (phase_index_ + 1 < phases_.size() && mcts->getNumSimulation() == phases_[phase_index_ + 1].first_simulation_) {
+        // all visits of the phase are backed up, keep the candidates with the best scores for the next phase
+        ++phase_index_;
+        selectTopCandidatesByScore(mcts, phases_[phase_index_].num_candidates_);
+        candidates_.resize(phases_[phase_index_].num_candidates_);
+        sortCandidatesByPolicyLogit();
     }
 }
 
-void GumbelZero::sortCandidatesByScore(const std::shared_ptr<MCTS>& mcts)
+void GumbelZero::selectTopCandidatesByScore(const std::shared_ptr<MCTS>& mcts, int size)
 {
-    assert(!candidates_.empty());
+    // score each candidate once, then only order the best ones
+    assert(!candidates_.empty() && size > 0);
+    size = std::min<int>(size, candidates_.size());
     float max_child_count = 0;
     for (int i = 0; i < mcts->getRootNode()->getNumChildren(); ++i) { max_child_count = fmax(max_child_count, mcts->getRootNode()->getChild(i)->getCount()); }
-    auto& tree_value_bound = mcts->getTreeValueBound();
-    sort(candidates_.begin(), candidates_.end(), [&](const MCTSNode* lhs, const MCTSNode* rhs) {
-        float min_value = -std::numeric_limits<float>::max();
-        float lhs_value = lhs->getNormalizedMean(tree_value_bound);
-        float lhs_score = lhs->getPolicyLogit() + (config::actor_gumbel_sigma_visit_c + max_child_count) * config::actor_gumbel_sigma_scale_c * lhs_value;
-        lhs_score = (lhs->getCount() > 0 ? lhs_score : min_value);
-        float rhs_value = rhs->getNormalizedMean(tree_value_bound);
-        float rhs_score = rhs->getPolicyLogit() + (config::actor_gumbel_sigma_visit_c + max_child_count) * config::actor_gumbel_sigma_scale_c * rhs_value;
-        rhs_score = (rhs->getCount() > 0 ? rhs_score : min_value);
-        return lhs_score > rhs_score;
-    });
+    const float value_lower_bound = mcts->getTreeValueBound().getLowerBound(), value_upper_bound = mcts->getTreeValueBound().getUpperBound();
+    candidate_scores_.clear();
+    for (MCTSNode* candidate : candidates_) {
+        float value = candidate->getNormalizedMean(value_lower_bound, value_upper_bound);
+        float score = candidate->getPolicyLogit() + (config::actor_gumbel_sigma_visit_c + max_child_count) * config::actor_gumbel_sigma_scale_c * value;
+        candidate_scores_.emplace_back(candidate->getCount() > 0 ? score : -std::numeric_limits<float>::max(), candidate);
+    }
+    std::partial_sort(candidate_scores_.begin(), candidate_scores_.begin() + size, candidate_scores_.end(), [](const std::pair<float, MCTSNode*>& lhs, const std::pair<float, MCTSNode*>& rhs) { return lhs.first > rhs.first; });
+    for (size_t i = 0; i < candidates_.size(); ++i) { candidates_[i] = candidate_scores_[i].second; }
+}
+
+int GumbelZero::getNumPhaseSimulationsLeft() const
+{
+    // the last phase continues the rounds until the search is done
+    if (phase_index_ + 1 >= phases_.size()) { return std::numeric_limits<int>::max(); }
+    return phases_[phase_index_ + 1].first_simulation_ - next_simulation_;
+}
+
+void GumbelZero::schedulePhases(int num_candidates)
+{
+    // the number of candidates and visits of every phase only depend on the configuration, so the whole schedule is decided up front;
+    // simulation 0 expands the root, and each phase ends once every candidate has reached its budget
+    const int num_simulation = config::actor_num_simulation;
+    const int sample_size = config::actor_gumbel_sample_size;
+    int phase_sample_size = sample_size;
+    int num_visits = std::max(1.0, std::floor(num_simulation / (std::log2(sample_size) * phase_sample_size)));
+    phases_.clear();
+    phases_.emplace_back(1, num_candidates);
+    while (true) {
+        int next_num_visits = std::floor(num_simulation / (std::log2(sample_size) * phase_sample_size / 2));
+        if (next_num_visits <= 0 || phase_sample_size <= 2) { break; }
+        phase_sample_size /= 2;
+        int first_simulation = phases_.back().first_simulation_ + phases_.back().num_candidates_ * num_visits;
+        phases_.emplace_back(first_simulation, std::min(phases_.back().num_candidates_, phase_sample_size));
+        num_visits = next_num_visits;
+        if (first_simulation > num_simulation) { break; } // the search is done before this phase
+    }
+    phase_index_ = 0;
+    next_simulation_ = 1;
+}
+
+void GumbelZero::sortCandidatesByPolicyLogit()
+{
+    sort(candidates_.begin(), candidates_.end(), [](const MCTSNode* lhs, const MCTSNode* rhs) { return lhs->getPolicyLogit() > rhs->getPolicyLogit(); });
 }
 
 } // namespace minizero::actor
@@ -3,22 +3,39 @@
 #include "mcts.h"
 #include <memory>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace minizero::actor {
 
 class GumbelZero {
 public:
+    // a phase of sequential halving, in which every candidate is visited the same number of times in rounds
+    class Phase {
+    public:
+        int first_simulation_;
+        int num_candidates_;
+        Phase(int first_simulation, int num_candidates)
+            : first_simulation_(first_simulation), num_candidates_(num_candidates) {}
+    };
+
     std::string getMCTSPolicy(const std::shared_ptr<MCTS>& mcts) const;
     MCTSNode* decideActionNode(const std::shared_ptr<MCTS>& mcts);
     std::vector<MCTSNode*> selection(const std::shared_ptr<MCTS>& mcts);
+    void cancelSelection(const std::shared_ptr<MCTS>& mcts);
     void sequentialHalving(const std::shared_ptr<MCTS>& mcts);
-    void sortCandidatesByScore(const std::shared_ptr<MCTS>& mcts);
+    void selectTopCandidatesByScore(const std::shared_ptr<MCTS>& mcts, int size);
+    int getNumPhaseSimulationsLeft() const;
 
 private:
-    int sample_size_;
-    int simulation_budget_;
+    void schedulePhases(int num_candidates);
+    void sortCandidatesByPolicyLogit();
+
+    int next_simulation_;
+    size_t phase_index_;
+    std::vector<Phase> phases_;
     std::vector<MCTSNode*> candidates_;
+    std::vector<std::pair<float, MCTSNode*>> candidate_scores_;
 };
 
 } // namespace minizero::actor
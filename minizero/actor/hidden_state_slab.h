@@ -0,0 +1,103 @@
+#pragma once
+
+#include "float16.h"
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace minizero::actor {
+
+enum class HiddenStatePrecision {
+    kFloat32,
+    kFloat16,
+    kBFloat16
+};
+
+inline HiddenStatePrecision stringToHiddenStatePrecision(const std::string& precision)
+{
+    if (precision == "fp32") {
+        return HiddenStatePrecision::kFloat32;
+    } else if (precision == "fp16") {
+        return HiddenStatePrecision::kFloat16;
+    } else if (precision == "bf16") {
+        return HiddenStatePrecision::kBFloat16;
+    }
+    assert(false);
+    return HiddenStatePrecision::kFloat32;
+}
+
+// the hidden states of a tree stored as fixed-width rows in one contiguous buffer, optionally at half precision
+// the buffer keeps its capacity across reset(), so a tree stops allocating once it has grown to its working size
+class HiddenStateSlab {
+public:
+    HiddenStateSlab() : row_size_(0), precision_(HiddenStatePrecision::kFloat32) { reset(); }
+
+    inline void reset() { num_rows_ = 0; }
+    inline void reset(HiddenStatePrecision precision)
+    {
+        reset();
+        precision_ = precision;
+    }
+
+    inline int store(const float* hidden_state, int size)
+    {
+        // the row width is decided by the first hidden state
+        if (num_rows_ == 0) { row_size_ = size; }
+        assert(size == row_size_);
+        int index = num_rows_++;
+        if (data_.size() < num_rows_ * getRowBytes()) { data_.resize(num_rows_ * getRowBytes()); }
+        char* row = getRowAddress(index);
+        if (precision_ == HiddenStatePrecision::kFloat32) {
+            std::memcpy(row, hidden_state, getRowBytes());
+        } else {
+            uint16_t* half_row = reinterpret_cast<uint16_t*>(row);
+            for (int i = 0; i < row_size_; ++i) { half_row[i] = (precision_ == HiddenStatePrecision::kFloat16 ? utils::floatToHalf(hidden_state[i]) : utils::floatToBFloat16(hidden_state[i])); }
+        }
+        return index;
+    }
+    inline int store(const std::vector<float>& hidden_state) { return store(hidden_state.data(), hidden_state.size()); }
+
+    // copy a row from another slab of the same precision without converting it
+    inline int store(const HiddenStateSlab& slab, int index)
+    {
+        assert(precision_ == slab.precision_ && index >= 0 && index < slab.size());
+        if (num_rows_ == 0) { row_size_ = slab.row_size_; }
+        assert(row_size_ == slab.row_size_);
+        int new_index = num_rows_++;
+        if (data_.size() < num_rows_ * getRowBytes()) { data_.resize(num_rows_ * getRowBytes()); }
+        std::memcpy(getRowAddress(new_index), slab.getRowAddress(index), getRowBytes());
+        return new_index;
+    }
+
+    // write a row as floats into the destination, e.g., the network input buffer
+    inline void load(int index, float* hidden_state) const
+    {
+        assert(index >= 0 && index < size());
+        const char* row = getRowAddress(index);
+        if (precision_ == HiddenStatePrecision::kFloat32) {
+            std::memcpy(hidden_state, row, getRowBytes());
+        } else {
+            const uint16_t* half_row = reinterpret_cast<const uint16_t*>(row);
+            for (int i = 0; i < row_size_; ++i) { hidden_state[i] = (precision_ == HiddenStatePrecision::kFloat16 ? utils::halfToFloat(half_row[i]) : utils::bfloat16ToFloat(half_row[i])); }
+        }
+    }
+
+    inline int size() const { return num_rows_; }
+    inline int getRowSize() const { return row_size_; }
+    inline size_t getRowBytes() const { return row_size_ * (precision_ == HiddenStatePrecision::kFloat32 ? sizeof(float) : sizeof(uint16_t)); }
+    inline size_t getCapacityBytes() const { return data_.size(); }
+    inline HiddenStatePrecision getPrecision() const { return precision_; }
+
+private:
+    inline char* getRowAddress(int index) { return data_.data() + static_cast<size_t>(index) * getRowBytes(); }
+    inline const char* getRowAddress(int index) const { return data_.data() + static_cast<size_t>(index) * getRowBytes(); }
+
+    int row_size_;
+    int num_rows_;
+    HiddenStatePrecision precision_;
+    std::vector<char> data_;
+};
+
+} // namespace minizero::actor
@@ -2,7 +2,35 @@
 
 namespace minizero::actor {
 
-void MCTSNode::reset()
+namespace {
+
+// the value and PUCT formulas shared by all node layouts
+template <class Node>
+inline float calculateNormalizedMean(const Node& node, float value_lower_bound, float value_upper_bound)
+{
+    float value = node.getReward() + config::actor_mcts_reward_discount * node.getMean();
+    if (config::actor_mcts_value_rescale) {
+        if (value_upper_bound <= value_lower_bound) { return 1.0f; } // fewer than two different values in the tree
+        value = (value - value_lower_bound) / (value_upper_bound - value_lower_bound);
+        value = fmin(1, fmax(-1, 2 * value - 1)); // normalize to [-1, 1]
+    }
+    value = (node.getAction().getPlayer() == env::charToPlayer(config::actor_mcts_value_flipping_player) ? -value : value); // flip value according to player
+    value = (value * node.getCount() - node.getVirtualLoss()) / node.getCountWithVirtualLoss();                          // value with virtual loss
+    return value;
+}
+
+template <class Node>
+inline float calculateNormalizedPUCTScore(const Node& node, int total_simulation, float value_lower_bound, float value_upper_bound, float init_q_value)
+{
+    float puct_bias = config::actor_mcts_puct_init + log((1 + total_simulation + config::actor_mcts_puct_base) / config::actor_mcts_puct_base);
+    float value_u = (puct_bias * node.getPolicy() * sqrt(total_simulation)) / (1 + node.getCountWithVirtualLoss());
+    float value_q = (node.getCountWithVirtualLoss() == 0 ? init_q_value : node.getNormalizedMean(value_lower_bound, value_upper_bound));
+    return value_u + value_q;
+}
+
+} // namespace
+
+void FullMCTSNode::reset()
 {
     num_children_ = 0;
     hidden_state_data_index_ = -1;
@@ -14,10 +42,11 @@ void MCTSNode::reset()
     policy_noise_ = 0.0f;
     value_ = 0.0f;
     reward_ = 0.0f;
+    proven_winner_ = env::Player::kPlayerNone;
     first_child_ = nullptr;
 }
 
-void MCTSNode::add(float value, float weight /* = 1.0f */)
+void FullMCTSNode::add(float value, float weight /* = 1.0f */)
 {
     if (count_ + weight <= 0) {
         reset();
@@ -27,7 +56,7 @@ void MCTSNode::add(float value, float weight /* = 1.0f */)
     }
 }
 
-void MCTSNode::remove(float value, float weight /* = 1.0f */)
+void FullMCTSNode::remove(float value, float weight /* = 1.0f */)
 {
     if (count_ - weight <= 0) {
         reset();
@@ -37,30 +66,17 @@ void MCTSNode::remove(float value, float weight /* = 1.0f */)
     }
 }
 
-float MCTSNode::getNormalizedMean(const std::map<float, int>& tree_value_bound) const
+float FullMCTSNode::getNormalizedMean(float value_lower_bound, float value_upper_bound) const
 {
-    float value = reward_ + config::actor_mcts_reward_discount * mean_;
-    if (config::actor_mcts_value_rescale) {
-        if (tree_value_bound.size() < 2) { return 1.0f; }
-        const float value_lower_bound = tree_value_bound.begin()->first;
-        const float value_upper_bound = tree_value_bound.rbegin()->first;
-        value = (value - value_lower_bound) / (value_upper_bound - value_lower_bound);
-        value = fmin(1, fmax(-1, 2 * value - 1)); // normalize to [-1, 1]
-    }
-    value = (action_.getPlayer() == env::charToPlayer(config::actor_mcts_value_flipping_player) ? -value : value); // flip value according to player
-    value = (value * count_ - virtual_loss_) / getCountWithVirtualLoss();    // value with virtual loss
-    return value;
+    return calculateNormalizedMean(*this, value_lower_bound, value_upper_bound);
 }
 
-float MCTSNode::getNormalizedPUCTScore(int total_simulation, const std::map<float, int>& tree_value_bound, float init_q_value /* = -1.0f */) const
+float FullMCTSNode::getNormalizedPUCTScore(int total_simulation, float value_lower_bound, float value_upper_bound, float init_q_value /* = -1.0f */) const
 {
-    float puct_bias = config::actor_mcts_puct_init + log((1 + total_simulation + config::actor_mcts_puct_base) / config::actor_mcts_puct_base);
-    float value_u = (puct_bias * getPolicy() * sqrt(total_simulation)) / (1 + getCountWithVirtualLoss());
-    float value_q = (getCountWithVirtualLoss() == 0 ? init_q_value : getNormalizedMean(tree_value_bound));
-    return value_u + value_q;
+    return calculateNormalizedPUCTScore(*this, total_simulation, value_lower_bound, value_upper_bound, init_q_value);
 }
 
-std::string MCTSNode::toString() const
+std::string FullMCTSNode::toString() const
 {
     std::ostringstream oss;
     oss.precision(4);
@@ -71,30 +87,97 @@ std::string MCTSNode::toString() const
         << ", r = " << reward_
         << ", mean = " << mean_
         << ", count = " << count_;
+    if (isProven()) { oss << ", proven winner = " << env::playerToChar(proven_winner_); }
     return oss.str();
 }
 
-void MCTS::reset()
+void CompactMCTSNode::reset()
 {
-    Tree::reset();
-    tree_hidden_state_data_.reset();
+    num_children_ = 0;
+    hidden_state_data_index_ = -1;
+    mean_ = 0.0f;
+    count_ = 0.0f;
+    virtual_loss_ = 0;
+    policy_ = 0.0f;
+    policy_logit_ = utils::floatToHalf(0.0f);
+    value_ = utils::floatToHalf(0.0f);
+    reward_ = utils::floatToHalf(0.0f);
+    first_child_ = 0;
+    action_ = 0;
+    proven_winner_ = 0;
+}
+
+void CompactMCTSNode::add(float value, float weight /* = 1.0f */)
+{
+    if (count_ + weight <= 0) {
+        reset();
+    } else {
+        count_ += weight;
+        mean_ += weight * (value - mean_) / count_;
+    }
+}
+
+void CompactMCTSNode::remove(float value, float weight /* = 1.0f */)
+{
+    if (count_ - weight <= 0) {
+        reset();
+    } else {
+        count_ -= weight;
+        mean_ -= weight * (value - mean_) / count_;
+    }
+}
+
+float CompactMCTSNode::getNormalizedMean(float value_lower_bound, float value_upper_bound) const
+{
+    return calculateNormalizedMean(*this, value_lower_bound, value_upper_bound);
+}
+
+float CompactMCTSNode::getNormalizedPUCTScore(int total_simulation, float value_lower_bound, float value_upper_bound, float init_q_value /* = -1.0f */) const
+{
+    return calculateNormalizedPUCTScore(*this, total_simulation, value_lower_bound, value_upper_bound, init_q_value);
+}
+
+std::string CompactMCTSNode::toString() const
+{
+    std::ostringstream oss;
+    oss.precision(4);
+    oss << std::fixed << "p = " << policy_
+        << ", p_logit = " << getPolicyLogit()
+        << ", p_noise = " << getPolicyNoise()
+        << ", v = " << getValue()
+        << ", r = " << getReward()
+        << ", mean = " << mean_
+        << ", count = " << count_;
+    if (isProven()) { oss << ", proven winner = " << env::playerToChar(getProvenWinner()); }
+    return oss.str();
+}
+
+template <class Node>
+void BasicMCTS<Node>::reset()
+{
+    resetTree();
+    use_child_statistics_ = config::actor_mcts_simd_selection;
+    updateNodeStatistics(getRootNode());
+    hidden_state_slab_.reset(stringToHiddenStatePrecision(config::actor_mcts_hidden_state_precision));
     tree_value_bound_.clear();
 }
 
-bool MCTS::isResign(const MCTSNode* selected_node) const
+template <class Node>
+bool BasicMCTS<Node>::isResign(const Node* selected_node) const
 {
-    float root_win_rate = getRootNode()->getNormalizedMean(tree_value_bound_);
-    float action_win_rate = selected_node->getNormalizedMean(tree_value_bound_);
+    float root_win_rate = getNormalizedMean(getRootNode());
+    float action_win_rate = getNormalizedMean(selected_node);
     return (-root_win_rate < config::actor_resign_threshold && action_win_rate < config::actor_resign_threshold);
 }
 
-MCTSNode* MCTS::selectChildByMaxCount(const MCTSNode* node) const
+template <class Node>
+Node* BasicMCTS<Node>::selectChildByMaxCount(const Node* node) const
 {
     assert(node && !node->isLeaf());
     float max_count = 0.0f;
-    MCTSNode* selected = nullptr;
+    Node* selected = nullptr;
     for (int i = 0; i < node->getNumChildren(); ++i) {
-        MCTSNode* child = node->getChild(i);
+        Node* child = node->getChild(i);
         if (child->getCount() <= max_count) { continue; }
         max_count = child->getCount();
         selected = child;
@@ -103,17 +186,19 @@ MCTSNode* MCTS::selectChildByMaxCount(const MCTSNode* node) const
     return selected;
 }
 
-MCTSNode* MCTS::selectChildBySoftmaxCount(const MCTSNode* node, float temperature /* = 1.0f */, float value_threshold /* = 0.1f */) const
+template <class Node>
+Node* BasicMCTS<Node>::selectChildBySoftmaxCount(const Node* node, float temperature /* = 1.0f */, float value_threshold /* = 0.1f */) const
 {
     assert(node && !node->isLeaf());
-    MCTSNode* selected = nullptr;
-    MCTSNode* best_child = selectChildByMaxCount(node);
-    float best_mean = best_child->getNormalizedMean(tree_value_bound_);
+    Node* selected = nullptr;
+    Node* best_child = selectChildByMaxCount(node);
+    const float value_lower_bound = tree_value_bound_.getLowerBound(), value_upper_bound = tree_value_bound_.getUpperBound();
+    float best_mean = best_child->getNormalizedMean(value_lower_bound, value_upper_bound);
     float sum = 0.0f;
     for (int i = 0; i < node->getNumChildren(); ++i) {
-        MCTSNode* child = node->getChild(i);
+        Node* child = node->getChild(i);
         float count = std::pow(child->getCount(), 1 / temperature);
-        float mean = child->getNormalizedMean(tree_value_bound_);
+        float mean = child->getNormalizedMean(value_lower_bound, value_upper_bound);
         if (count == 0 || (mean < best_mean - value_threshold)) { continue; }
         sum += count;
         float rand = utils::Random::randReal(sum);
@@ -123,12 +208,13 @@ MCTSNode* MCTS::selectChildBySoftmaxCount(const MCTSNode* node, float temperatur
     return selected;
 }
 
-std::string MCTS::getSearchDistributionString() const
+template <class Node>
+std::string BasicMCTS<Node>::getSearchDistributionString() const
 {
-    const MCTSNode* root = getRootNode();
+    const Node* root = getRootNode();
     std::ostringstream oss;
     for (int i = 0; i < root->getNumChildren(); ++i) {
-        MCTSNode* child = root->getChild(i);
+        Node* child = root->getChild(i);
         if (child->getCount() == 0) { continue; }
         oss << (oss.str().empty() ? "" : ",")
             << child->getAction().getActionID() << ":" << child->getCount();
@@ -136,58 +222,175 @@ std::string MCTS::getSearchDistributionString() const
     return oss.str();
 }
 
-std::vector<MCTSNode*> MCTS::selectFromNode(MCTSNode* start_node)
+template <class Node>
+std::vector<Node*> BasicMCTS<Node>::selectFromNode(Node* start_node)
 {
     assert(start_node);
-    MCTSNode* node = start_node;
-    std::vector<MCTSNode*> node_path{node};
-    while (!node->isLeaf()) {
-        node = selectChildByPUCTScore(node);
+    Node* node = start_node;
+    std::vector<Node*> node_path{node};
+    // a proven node is not searched further, its known value is backed up instead
+    while (!node->isLeaf() && !(config::actor_mcts_solver && node->isProven())) {
+        node = (isChanceNode(node) ? selectChildByChance(node) : selectChildByPUCTScore(node));
         node_path.push_back(node);
     }
     return node_path;
 }
 
-void MCTS::expand(MCTSNode* leaf_node, const std::vector<ActionCandidate>& action_candidates)
+template <class Node>
+void BasicMCTS<Node>::expand(Node* leaf_node, const std::vector<ActionCandidate>& action_candidates)
 {
     assert(leaf_node && action_candidates.size() > 0);
     leaf_node->setFirstChild(allocateNodes(action_candidates.size()));
     leaf_node->setNumChildren(action_candidates.size());
     for (size_t i = 0; i < action_candidates.size(); ++i) {
         const auto& candidate = action_candidates[i];
-        MCTSNode* child = leaf_node->getChild(i);
+        Node* child = leaf_node->getChild(i);
         child->reset();
         child->setAction(candidate.action_);
         child->setPolicy(candidate.policy_);
         child->setPolicyLogit(candidate.policy_logit_);
     }
+    updateChildStatistics(leaf_node);
 }
 
-void MCTS::backup(const std::vector<MCTSNode*>& node_path, const float value, const float reward /* = 0.0f */)
+template <class Node>
+void BasicMCTS<Node>::backup(const std::vector<Node*>& node_path, const float value, const float reward /* = 0.0f */)
 {
     assert(node_path.size() > 0);
     float updated_value = value;
     node_path.back()->setValue(value);
     node_path.back()->setReward(reward);
     for (int i = static_cast<int>(node_path.size() - 1); i >= 0; --i) {
-        MCTSNode* node = node_path[i];
-        float old_mean = node->getReward() + config::actor_mcts_reward_discount * node->getMean();
+        Node* node = node_path[i];
+        const float discount = (isChanceEvent(node) ? 1.0f : config::actor_mcts_reward_discount); // a chance event does not take a time step
+        float old_mean = node->getReward() + discount * node->getMean();
         node->add(updated_value);
-        updateTreeValueBound(old_mean, node->getReward() + config::actor_mcts_reward_discount * node->getMean());
-        updated_value = node->getReward() + config::actor_mcts_reward_discount * updated_value;
+        if (isChanceNode(node)) {
+            // back up the expectation over the chance events instead of the sampled one
+            node->setMean(calculateChanceNodeMean(node));
+            updated_value = node->getMean();
+        }
+        updateNodeStatistics(node);
+        updateTreeValueBound(old_mean, node->getReward() + discount * node->getMean());
+        updated_value = node->getReward() + discount * updated_value;
+        if (config::actor_mcts_solver && i > 0 && node->isProven() && !node_path[i - 1]->isProven()) { updateProvenWinner(node_path[i - 1]); }
+    }
+}
+
+template <class Node>
+void BasicMCTS<Node>::reuseSubtree(Node* new_root)
+{
+    assert(new_root && new_root != getRootNode());
+
+    // collect the subtree in breadth-first order, so that the position in the order is exactly the new index and sibling nodes stay contiguous
+    std::vector<Node*> subtree_nodes{new_root};
+    std::vector<int> first_child_index{-1};
+    for (size_t i = 0; i < subtree_nodes.size(); ++i) {
+        Node* node = subtree_nodes[i];
+        if (node->isLeaf()) { continue; }
+        first_child_index[i] = subtree_nodes.size();
+        for (int j = 0; j < node->getNumChildren(); ++j) {
+            subtree_nodes.push_back(node->getChild(j));
+            first_child_index.push_back(-1);
+        }
+    }
+
+    // copy nodes out first since the old and new positions may overlap, then reallocate them from the front of the arena
+    std::vector<Node> compact_nodes;
+    std::vector<float> policy_noises;
+    compact_nodes.reserve(subtree_nodes.size());
+    policy_noises.reserve(subtree_nodes.size());
+    for (Node* node : subtree_nodes) {
+        compact_nodes.push_back(*node);
+        policy_noises.push_back(node->getPolicyNoise()); // may live outside the node, read it before the tree is reset
+    }
+
+    std::swap(hidden_state_slab_, reuse_hidden_state_slab_);
+    hidden_state_slab_.reset(reuse_hidden_state_slab_.getPrecision());
+    tree_value_bound_.clear();
+    resetTree();
+    std::vector<Node*> new_nodes(compact_nodes.size(), nullptr);
+    new_nodes[0] = getRootNode();
+    for (size_t i = 0; i < compact_nodes.size(); ++i) {
+        Node* node = new_nodes[i];
+        *node = compact_nodes[i];
+        if (policy_noises[i] != 0.0f) { node->setPolicyNoise(policy_noises[i]); }
+        node->setFirstChild(first_child_index[i] == -1 ? nullptr : allocateNodes(node->getNumChildren()));
+        for (int j = 0; j < node->getNumChildren(); ++j) { new_nodes[first_child_index[i] + j] = node->getChild(j); }
+        if (node->getHiddenStateDataIndex() != -1 && !config::actor_mcts_device_hidden_state) { node->setHiddenStateDataIndex(hidden_state_slab_.store(reuse_hidden_state_slab_, node->getHiddenStateDataIndex())); }
+        if (config::actor_mcts_value_rescale && node->getCount() > 0) { tree_value_bound_.add(node->getReward() + (isChanceEvent(node) ? 1.0f : config::actor_mcts_reward_discount) * node->getMean()); }
+        updateNodeStatistics(node);
+    }
+}
+
+template <class Node>
+void BasicMCTS<Node>::addVirtualLoss(const std::vector<Node*>& node_path, float num /* = 1.0f */)
+{
+    for (auto node : node_path) {
+        node->addVirtualLoss(num);
+        updateNodeStatistics(node);
+    }
+}
+
+template <class Node>
+void BasicMCTS<Node>::removeVirtualLoss(const std::vector<Node*>& node_path, float num /* = 1.0f */)
+{
+    for (auto node : node_path) {
+        node->removeVirtualLoss(num);
+        updateNodeStatistics(node);
     }
 }
 
-MCTSNode* MCTS::selectChildByPUCTScore(const MCTSNode* node) const
+template <class Node>
+Node* BasicMCTS<Node>::findProvenWinningChild(const Node* node) const
 {
     assert(node && !node->isLeaf());
-    MCTSNode* selected = nullptr;
+    Node* first_child = node->getChild(0);
+    const env::Player player = first_child->getAction().getPlayer(); // the player to move at the node
+    for (int i = 0; i < node->getNumChildren(); ++i) {
+        if ((first_child + i)->getProvenWinner() == player) { return first_child + i; }
+    }
+    return nullptr;
+}
+
+template <class Node>
+void BasicMCTS<Node>::updateChildStatistics(const Node* node)
+{
+    if (!useChildStatistics()) { return; }
+    for (int i = 0; i < node->getNumChildren(); ++i) { updateNodeStatistics(node->getChild(i)); }
+}
+
+template <class Node>
+Node* BasicMCTS<Node>::selectChildByPUCTScore(const Node* node) const
+{
+    assert(node && !node->isLeaf());
+    if (useChildStatistics()) {
+        // the kernel does not know proven nodes, so a proven win is taken first as in the scalar scores,
+        // and the children are selected again by the scalar scores in the rare case that the kernel picks a proven loss
+        if (config::actor_mcts_solver) {
+            if (Node* winning_child = findProvenWinningChild(node)) { return winning_child; }
+        }
+        Node* selected = selectChildByPUCTKernel(node);
+        if (!config::actor_mcts_solver || !selected->isProven() || selected->getProvenWinner() == selected->getAction().getPlayer()) { return selected; }
+    }
+    Node* selected = nullptr;
     int total_simulation = node->getCountWithVirtualLoss() - 1;
-    float init_q_value = calculateInitQValue(node);
+    const float value_lower_bound = tree_value_bound_.getLowerBound(), value_upper_bound = tree_value_bound_.getUpperBound();
+    float init_q_value = calculateInitQValue(node, value_lower_bound, value_upper_bound);
     float best_score = std::numeric_limits<float>::lowest(), best_policy = std::numeric_limits<float>::lowest();
+    Node* first_child = node->getChild(0); // siblings are contiguous, avoid resolving each child from its parent
     for (int i = 0; i < node->getNumChildren(); ++i) {
-        MCTSNode* child = node->getChild(i);
-        float score = child->getNormalizedPUCTScore(total_simulation, tree_value_bound_, init_q_value);
+        Node* child = first_child + i;
+        if (child->isProven()) {
+            // always take a proven win, and only take a proven loss if all children are proven losses
+            if (child->getProvenWinner() == child->getAction().getPlayer()) { return child; }
+            if (best_score == std::numeric_limits<float>::lowest() && best_policy < child->getPolicy()) {
+                best_policy = child->getPolicy();
+                selected = child;
+            }
+            continue;
+        }
+        float score = child->getNormalizedPUCTScore(total_simulation, value_lower_bound, value_upper_bound, init_q_value);
         if (score < best_score || (score == best_score && child->getPolicy() <= best_policy)) { continue; }
         best_score = score;
         best_policy = child->getPolicy();
@@ -197,17 +400,59 @@ MCTSNode* MCTS::selectChildByPUCTScore(const MCTSNode* node) const
     return selected;
 }
 
-float MCTS::calculateInitQValue(const MCTSNode* node) const
+template <class Node>
+Node* BasicMCTS<Node>::selectChildByChance(const Node* node) const
+{
+    // pick the chance event visited the least relative to its probability, so that the visits follow the probabilities without sampling
+    assert(node && !node->isLeaf());
+    Node* selected = nullptr;
+    float best_score = std::numeric_limits<float>::lowest();
+    Node* first_child = node->getChild(0);
+    for (int i = 0; i < node->getNumChildren(); ++i) {
+        Node* child = first_child + i;
+        float score = child->getPolicy() / (1 + child->getCountWithVirtualLoss());
+        if (score <= best_score) { continue; }
+        best_score = score;
+        selected = child;
+    }
+    assert(selected != nullptr);
+    return selected;
+}
+
+template <class Node>
+float BasicMCTS<Node>::calculateChanceNodeMean(const Node* node) const
+{
+    // the probability-weighted mean of the visited chance events, whose probabilities are stored as their policies
+    float sum_of_value = 0.0f, sum_of_probability = 0.0f;
+    const Node* first_child = node->getChild(0);
+    for (int i = 0; i < node->getNumChildren(); ++i) {
+        const Node* child = first_child + i;
+        if (child->getCount() == 0) { continue; }
+        sum_of_value += child->getPolicy() * (child->getReward() + child->getMean());
+        sum_of_probability += child->getPolicy();
+    }
+    return (sum_of_probability > 0.0f ? sum_of_value / sum_of_probability : node->getMean());
+}
+
+template <class Node>
+float BasicMCTS<Node>::calculateInitQValue(const Node* node, float value_lower_bound, float value_upper_bound) const
 {
     // init Q value = avg Q value of all visited children + one loss
     assert(node && !node->isLeaf());
     float sum_of_win = 0.0f, sum = 0.0f;
+    const Node* first_child = node->getChild(0);
     for (int i = 0; i < node->getNumChildren(); ++i) {
-        MCTSNode* child = node->getChild(i);
+        const Node* child = first_child + i;
         if (child->getCountWithVirtualLoss() == 0) { continue; }
-        sum_of_win += child->getNormalizedMean(tree_value_bound_);
+        sum_of_win += child->getNormalizedMean(value_lower_bound, value_upper_bound);
         sum += 1;
     }
+    return calculateInitQValue(sum_of_win, sum);
+}
+
+template <class Node>
+float BasicMCTS<Node>::calculateInitQValue(float sum_of_win, float sum) const
+{
 #if ATARI
     // explore more in Atari games (TODO: check if this method also performs better in board games)
     return (sum > 0 ? sum_of_win / sum : 1.0f);
@@ -216,15 +461,73 @@ float MCTS::calculateInitQValue(const MCTSNode* node) const
 #endif
 }
 
-void MCTS::updateTreeValueBound(float old_value, float new_value)
+template <class Node>
+Node* BasicMCTS<Node>::selectChildByPUCTKernel(const Node* node) const
+{
+    // score all children from the contiguous statistics in a single pass, and decide the init Q value afterwards
+    const Node* first_child = node->getChild(0);
+    int total_simulation = node->getCountWithVirtualLoss() - 1;
+    PUCTKernelParameter parameter;
+    parameter.puct_bias_ = config::actor_mcts_puct_init + log((1 + total_simulation + config::actor_mcts_puct_base) / config::actor_mcts_puct_base);
+    parameter.sqrt_total_simulation_ = sqrt(total_simulation);
+    parameter.reward_discount_ = config::actor_mcts_reward_discount;
+    parameter.value_sign_ = (first_child->getAction().getPlayer() == env::charToPlayer(config::actor_mcts_value_flipping_player) ? -1.0f : 1.0f); // siblings are actions of the same player
+    parameter.value_rescale_ = config::actor_mcts_value_rescale;
+    parameter.has_value_bound_ = tree_value_bound_.hasBound();
+    parameter.value_lower_bound_ = tree_value_bound_.getLowerBound();
+    parameter.value_upper_bound_ = tree_value_bound_.getUpperBound();
+
+    PUCTKernelResult result = calculatePUCTKernel(child_statistics_, getNodeIndex(first_child), node->getNumChildren(), parameter);
+    int selected_index = result.getSelectedIndex(calculateInitQValue(result.sum_of_visited_mean_, result.num_visited_));
+    assert(selected_index >= 0);
+    return node->getChild(selected_index);
+}
+
+template <class Node>
+void BasicMCTS<Node>::updateTreeValueBound(float old_value, float new_value)
 {
     if (!config::actor_mcts_value_rescale) { return; }
-    if (tree_value_bound_.count(old_value)) {
-        assert(tree_value_bound_[old_value] > 0);
-        --tree_value_bound_[old_value];
-        if (tree_value_bound_[old_value] == 0) { tree_value_bound_.erase(old_value); }
+    tree_value_bound_.update(old_value, new_value);
+}
+
+template <class Node>
+bool BasicMCTS<Node>::updateProvenWinner(Node* node)
+{
+    // a node is won by the player to move if any child is, and lost if all children are won by the opponent
+    assert(node && !node->isLeaf());
+    if (Node* winning_child = findProvenWinningChild(node)) {
+        node->setProvenWinner(winning_child->getProvenWinner());
+        return true;
+    }
+    Node* first_child = node->getChild(0);
+    for (int i = 0; i < node->getNumChildren(); ++i) {
+        if (!(first_child + i)->isProven()) { return false; }
     }
-    ++tree_value_bound_[new_value];
+    node->setProvenWinner(first_child->getProvenWinner());
+    return true;
 }
 
+template <class Node>
+void BasicMCTS<Node>::resetTree()
+{
+    Tree::reset();
+    new (root_) Node();
+}
+
+template <class Node>
+void BasicMCTS<Node>::updateNodeStatistics(const Node* node)
+{
+    if (!useChildStatistics()) { return; }
+    uint64_t index = getNodeIndex(node);
+    if (index >= child_statistics_.size()) { child_statistics_.resize(getNodeCapacity()); } // grow together with the arena
+    child_statistics_.policy_[index] = node->getPolicy();
+    child_statistics_.count_[index] = node->getCount();
+    child_statistics_.mean_[index] = node->getMean();
+    child_statistics_.reward_[index] = node->getReward();
+    child_statistics_.virtual_loss_[index] = node->getVirtualLoss();
+}
+
+template class BasicMCTS<FullMCTSNode>;
+template class BasicMCTS<CompactMCTSNode>;
+
 } // namespace minizero::actor
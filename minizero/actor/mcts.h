@@ -2,27 +2,32 @@
 
 #include "configuration.h"
 #include "environment.h"
+#include "float16.h"
+#include "hidden_state_slab.h"
+#include "puct_kernel.h"
 #include "random.h"
 #include "search.h"
 #include "tree.h"
+#include "value_bound.h"
 #include <algorithm>
 #include <cmath>
+#include <cstdint>
 #include <limits>
-#include <map>
+#include <new>
 #include <string>
 #include <vector>
 
 namespace minizero::actor {
 
-class MCTSNode : public TreeNode {
+class FullMCTSNode : public TreeNode {
 public:
-    MCTSNode() { reset(); }
+    FullMCTSNode() { reset(); }
 
     void reset() override;
     virtual void add(float value, float weight = 1.0f);
     virtual void remove(float value, float weight = 1.0f);
-    virtual float getNormalizedMean(const std::map<float, int>& tree_value_bound) const;
-    virtual float getNormalizedPUCTScore(int total_simulation, const std::map<float, int>& tree_value_bound, float init_q_value = -1.0f) const;
+    virtual float getNormalizedMean(float value_lower_bound, float value_upper_bound) const;
+    virtual float getNormalizedPUCTScore(int total_simulation, float value_lower_bound, float value_upper_bound, float init_q_value = -1.0f) const;
     std::string toString() const override;
     bool displayInTreeLog() const override { return count_ > 0; }
 
@@ -37,7 +42,8 @@ public:
     inline void setPolicyNoise(float policy_noise) { policy_noise_ = policy_noise; }
     inline void setValue(float value) { value_ = value; }
     inline void setReward(float reward) { reward_ = reward; }
-    inline void setFirstChild(MCTSNode* first_child) { TreeNode::setFirstChild(first_child); }
+    inline void setProvenWinner(env::Player proven_winner) { proven_winner_ = proven_winner; }
+    inline void setFirstChild(FullMCTSNode* first_child) { TreeNode::setFirstChild(first_child); }
 
     // getter
     inline int getHiddenStateDataIndex() const { return hidden_state_data_index_; }
@@ -50,7 +56,9 @@ public:
     inline float getPolicyNoise() const { return policy_noise_; }
     inline float getValue() const { return value_; }
     inline float getReward() const { return reward_; }
-    inline virtual MCTSNode* getChild(int index) const override { return (index < num_children_ ? static_cast<MCTSNode*>(first_child_) + index : nullptr); }
+    inline env::Player getProvenWinner() const { return proven_winner_; }
+    inline bool isProven() const { return proven_winner_ != env::Player::kPlayerNone; }
+    inline virtual FullMCTSNode* getChild(int index) const override { return (index < num_children_ ? static_cast<FullMCTSNode*>(first_child_) + index : nullptr); }
 
 protected:
     int hidden_state_data_index_;
@@ -62,17 +70,88 @@ protected:
     float policy_noise_;
     float value_;
     float reward_;
+    env::Player proven_winner_; // the game-theoretic winner found by the solver, kPlayerNone if not proven
 };
 
-class HiddenStateData {
+// a 32-byte node without virtual functions, reducing the memory and cache footprint of trees
+// children are referred by their 32-bit index in the tree, and rarely read fields are stored in half precision (policy noise in a side table)
+// half precision fields saturate at +-65504, e.g., the reward of merging two 32768 tiles in 2048 is stored as 65504 instead of infinity
+class CompactMCTSNode {
 public:
-    HiddenStateData(const std::vector<float>& hidden_state)
-        : hidden_state_(hidden_state) {}
-    std::vector<float> hidden_state_;
+    CompactMCTSNode() { reset(); }
+
+    void reset();
+    void add(float value, float weight = 1.0f);
+    void remove(float value, float weight = 1.0f);
+    float getNormalizedMean(float value_lower_bound, float value_upper_bound) const;
+    float getNormalizedPUCTScore(int total_simulation, float value_lower_bound, float value_upper_bound, float init_q_value = -1.0f) const;
+    std::string toString() const;
+    bool displayInTreeLog() const { return count_ > 0; }
+    inline bool isLeaf() const { return (num_children_ == 0); }
+
+    // setter
+    inline void setAction(const Action& action)
+    {
+        assert(action.getActionID() + 1 <= kActionIDMask);
+        action_ = (action.getActionID() + 1) | (static_cast<int>(action.getPlayer()) << kActionIDBits);
+    }
+    inline void setNumChildren(int num_children)
+    {
+        assert(num_children >= 0 && num_children <= std::numeric_limits<uint16_t>::max());
+        num_children_ = num_children;
+    }
+    inline void setFirstChild(CompactMCTSNode* first_child) { first_child_ = (first_child ? Tree::getTree(first_child)->getNodeIndex(first_child) : 0); }
+    inline void setHiddenStateDataIndex(int hidden_state_data_index) { hidden_state_data_index_ = hidden_state_data_index; }
+    inline void setMean(float mean) { mean_ = mean; }
+    inline void setCount(float count) { count_ = count; }
+    inline void addVirtualLoss(float num = 1.0f) { virtual_loss_ += static_cast<uint16_t>(num); }
+    inline void removeVirtualLoss(float num = 1.0f) { virtual_loss_ -= static_cast<uint16_t>(num); }
+    inline void setPolicy(float policy) { policy_ = policy; }
+    inline void setPolicyLogit(float policy_logit) { policy_logit_ = utils::floatToSaturatedHalf(policy_logit); }
+    inline void setPolicyNoise(float policy_noise) { Tree::getTree(this)->setSideValue(this, policy_noise); }
+    inline void setValue(float value) { value_ = utils::floatToSaturatedHalf(value); }
+    inline void setReward(float reward) { reward_ = utils::floatToSaturatedHalf(reward); }
+    inline void setProvenWinner(env::Player proven_winner) { proven_winner_ = static_cast<uint16_t>(proven_winner); }
+
+    // getter
+    inline Action getAction() const { return Action(static_cast<int>(action_ & kActionIDMask) - 1, static_cast<env::Player>(action_ >> kActionIDBits)); }
+    inline int getNumChildren() const { return num_children_; }
+    inline int getHiddenStateDataIndex() const { return hidden_state_data_index_; }
+    inline float getMean() const { return mean_; }
+    inline float getCount() const { return count_; }
+    inline float getCountWithVirtualLoss() const { return count_ + virtual_loss_; }
+    inline float getVirtualLoss() const { return virtual_loss_; }
+    inline float getPolicy() const { return policy_; }
+    inline float getPolicyLogit() const { return utils::halfToFloat(policy_logit_); }
+    inline float getPolicyNoise() const { return Tree::getTree(this)->getSideValue(this); }
+    inline float getValue() const { return utils::halfToFloat(value_); }
+    inline float getReward() const { return utils::halfToFloat(reward_); }
+    inline env::Player getProvenWinner() const { return static_cast<env::Player>(proven_winner_); }
+    inline bool isProven() const { return proven_winner_ != 0; }
+    inline CompactMCTSNode* getChild(int index) const { return (index < num_children_ ? static_cast<CompactMCTSNode*>(Tree::getTree(this)->getNodeAddress(first_child_ + index)) : nullptr); }
+
+private:
+    static constexpr int kActionIDBits = 14;
+    static constexpr uint16_t kActionIDMask = (1 << kActionIDBits) - 1;
+
+    float mean_;
+    float count_;
+    float policy_;
+    uint32_t first_child_;
+    int hidden_state_data_index_;
+    uint16_t num_children_;
+    uint16_t action_;       // action id + 1 in the lower 14 bits, player in the upper 2 bits
+    uint16_t virtual_loss_ : 14; // virtual losses are always added and removed in whole numbers
+    uint16_t proven_winner_ : 2; // env::Player
+    uint16_t policy_logit_; // half precision
+    uint16_t value_;        // half precision
+    uint16_t reward_;       // half precision
 };
-typedef TreeData<HiddenStateData> TreeHiddenStateData;
+static_assert(sizeof(CompactMCTSNode) == 32, "CompactMCTSNode should be 32 bytes");
 
-class MCTS : public Tree, public Search {
+// the search tree is parameterized by the node layout, either FullMCTSNode or CompactMCTSNode
+template <class Node>
+class BasicMCTS : public Tree, public Search {
 public:
     class ActionCandidate {
     public:
@@ -83,39 +162,81 @@ public:
             : action_(action), policy_(policy), policy_logit_(policy_logit) {}
     };
 
-    MCTS(uint64_t tree_node_size)
-        : Tree(tree_node_size) {}
+    BasicMCTS(uint64_t tree_node_size)
+        : Tree(tree_node_size, sizeof(Node)),
+          use_child_statistics_(false) {}
 
     void reset() override;
-    virtual bool isResign(const MCTSNode* selected_node) const;
-    virtual MCTSNode* selectChildByMaxCount(const MCTSNode* node) const;
-    virtual MCTSNode* selectChildBySoftmaxCount(const MCTSNode* node, float temperature = 1.0f, float value_threshold = 0.1f) const;
+    virtual bool isResign(const Node* selected_node) const;
+    virtual Node* selectChildByMaxCount(const Node* node) const;
+    virtual Node* selectChildBySoftmaxCount(const Node* node, float temperature = 1.0f, float value_threshold = 0.1f) const;
     virtual std::string getSearchDistributionString() const;
-    virtual std::vector<MCTSNode*> select() { return selectFromNode(getRootNode()); }
-    virtual std::vector<MCTSNode*> selectFromNode(MCTSNode* start_node);
-    virtual void expand(MCTSNode* leaf_node, const std::vector<ActionCandidate>& action_candidates);
-    virtual void backup(const std::vector<MCTSNode*>& node_path, const float value, const float reward = 0.0f);
-
-    inline MCTSNode* allocateNodes(int size) { return static_cast<MCTSNode*>(Tree::allocateNodes(size)); }
+    virtual std::vector<Node*> select() { return selectFromNode(getRootNode()); }
+    virtual std::vector<Node*> selectFromNode(Node* start_node);
+    virtual void expand(Node* leaf_node, const std::vector<ActionCandidate>& action_candidates);
+    virtual void backup(const std::vector<Node*>& node_path, const float value, const float reward = 0.0f);
+    virtual void reuseSubtree(Node* new_root);
+    virtual void addVirtualLoss(const std::vector<Node*>& node_path, float num = 1.0f);
+    virtual void removeVirtualLoss(const std::vector<Node*>& node_path, float num = 1.0f);
+    virtual Node* findProvenWinningChild(const Node* node) const;
+    void updateChildStatistics(const Node* node);
+
+    std::string toString(const std::string& env_string) const
+    {
+        assert(!env_string.empty() && env_string.back() == ')');
+        std::ostringstream oss;
+        const Node* pRoot = getRootNode();
+        std::string env_prefix = env_string.substr(0, env_string.size() - 1);
+        oss << env_prefix << "C[" << pRoot->toString() << "]" << getTreeInfo_r(pRoot) << ")";
+        return oss.str();
+    }
+
+    inline Node* allocateNodes(int size)
+    {
+        Node* nodes = static_cast<Node*>(allocateNodeMemory(size));
+        for (int i = 0; i < size; ++i) { new (nodes + i) Node(); }
+        return nodes;
+    }
     inline int getNumSimulation() const { return getRootNode()->getCount(); }
-    inline bool reachMaximumSimulation() const { return (getNumSimulation() == config::actor_num_simulation + 1); }
-    inline MCTSNode* getRootNode() { return static_cast<MCTSNode*>(Tree::getRootNode()); }
-    inline const MCTSNode* getRootNode() const { return static_cast<const MCTSNode*>(Tree::getRootNode()); }
-    inline TreeHiddenStateData& getTreeHiddenStateData() { return tree_hidden_state_data_; }
-    inline const TreeHiddenStateData& getTreeHiddenStateData() const { return tree_hidden_state_data_; }
-    inline std::map<float, int>& getTreeValueBound() { return tree_value_bound_; }
-    inline const std::map<float, int>& getTreeValueBound() const { return tree_value_bound_; }
+    inline bool reachMaximumSimulation() const { return (getNumSimulation() >= config::actor_num_simulation + 1); }
+    inline Node* getRootNode() { return static_cast<Node*>(root_); }
+    inline const Node* getRootNode() const { return static_cast<const Node*>(root_); }
+    inline HiddenStateSlab& getHiddenStateSlab() { return hidden_state_slab_; }
+    inline const HiddenStateSlab& getHiddenStateSlab() const { return hidden_state_slab_; }
+    inline ValueBound& getTreeValueBound() { return tree_value_bound_; }
+    inline const ValueBound& getTreeValueBound() const { return tree_value_bound_; }
+    inline float getNormalizedMean(const Node* node) const { return node->getNormalizedMean(tree_value_bound_.getLowerBound(), tree_value_bound_.getUpperBound()); }
+    inline bool useChildStatistics() const { return use_child_statistics_; }
+
+    // with actor_mcts_chance_node, the children of an afterstate (chance node) are chance events, whose actions belong to no player
+    inline bool isChanceEvent(const Node* node) const { return config::actor_mcts_chance_node && node->getAction().getPlayer() == env::Player::kPlayerNone; }
+    inline bool isChanceNode(const Node* node) const { return !node->isLeaf() && isChanceEvent(node->getChild(0)); }
 
 protected:
-    TreeNode* createTreeNodes(uint64_t tree_node_size) override { return new MCTSNode[tree_node_size]; }
-    TreeNode* getNodeIndex(int index) override { return getRootNode() + index; }
-
-    virtual MCTSNode* selectChildByPUCTScore(const MCTSNode* node) const;
-    virtual float calculateInitQValue(const MCTSNode* node) const;
+    virtual Node* selectChildByPUCTScore(const Node* node) const;
+    virtual Node* selectChildByChance(const Node* node) const;
+    virtual float calculateChanceNodeMean(const Node* node) const;
+    virtual float calculateInitQValue(const Node* node, float value_lower_bound, float value_upper_bound) const;
+    virtual Node* selectChildByPUCTKernel(const Node* node) const;
+    virtual float calculateInitQValue(float sum_of_win, float sum) const;
     virtual void updateTreeValueBound(float old_value, float new_value);
-
-    std::map<float, int> tree_value_bound_;
-    TreeHiddenStateData tree_hidden_state_data_;
+    virtual bool updateProvenWinner(Node* node);
+    void updateNodeStatistics(const Node* node);
+    void resetTree();
+
+    bool use_child_statistics_;
+    ValueBound tree_value_bound_;
+    PUCTChildStatistics child_statistics_;
+    HiddenStateSlab hidden_state_slab_;
+    HiddenStateSlab reuse_hidden_state_slab_; // the spare slab for moving hidden states in reuseSubtree()
 };
 
+// the node layout used by actors, selected at build time
+#if MCTS_COMPACT_NODE
+typedef CompactMCTSNode MCTSNode;
+#else
+typedef FullMCTSNode MCTSNode;
+#endif
+typedef BasicMCTS<MCTSNode> MCTS;
+
 } // namespace minizero::actor
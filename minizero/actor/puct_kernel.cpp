@@ -0,0 +1,265 @@
+#include "puct_kernel.h"
+#include <algorithm>
+#include <cassert>
+#include <utility>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define PUCT_KERNEL_X86 1
+#endif
+
+namespace minizero::actor {
+
+namespace {
+
+// keep the candidate with the higher score, then the higher policy, then the smaller index (the same order as scanning children one by one)
+inline void mergeCandidate(float score, float policy, int index, float& best_score, float& best_policy, int& best_index)
+{
+    if (index < 0) { return; }
+    if (score < best_score) { return; }
+    if (score == best_score && best_index >= 0) {
+        if (policy < best_policy || (policy == best_policy && index > best_index)) { return; }
+    }
+    best_score = score;
+    best_policy = policy;
+    best_index = index;
+}
+
+inline void updateResult(PUCTKernelResult& result, int index, float policy, float count, float mean, float reward, float virtual_loss, const PUCTKernelParameter& parameter)
+{
+    float count_with_virtual_loss = count + virtual_loss;
+    float value_u = (parameter.puct_bias_ * policy * parameter.sqrt_total_simulation_) / (1 + count_with_virtual_loss);
+    if (count_with_virtual_loss == 0) {
+        if (value_u < result.best_unvisited_score_ || (value_u == result.best_unvisited_score_ && policy <= result.best_unvisited_policy_)) { return; }
+        result.best_unvisited_score_ = value_u;
+        result.best_unvisited_policy_ = policy;
+        result.best_unvisited_index_ = index;
+        return;
+    }
+
+    float value = reward + parameter.reward_discount_ * mean;
+    if (parameter.value_rescale_) {
+        value = (value - parameter.value_lower_bound_) / (parameter.value_upper_bound_ - parameter.value_lower_bound_);
+        value = std::min(1.0f, std::max(-1.0f, 2 * value - 1));
+    }
+    value *= parameter.value_sign_;
+    float value_q = (value * count - virtual_loss) / count_with_virtual_loss;
+    if (parameter.value_rescale_ && !parameter.has_value_bound_) { value_q = 1.0f; } // no normalization before having two different values
+    result.sum_of_visited_mean_ += value_q;
+    result.num_visited_ += 1;
+
+    float score = value_u + value_q;
+    if (score < result.best_visited_score_ || (score == result.best_visited_score_ && policy <= result.best_visited_policy_)) { return; }
+    result.best_visited_score_ = score;
+    result.best_visited_policy_ = policy;
+    result.best_visited_index_ = index;
+}
+
+PUCTKernelResult calculatePUCTKernelScalar(const PUCTChildStatistics& statistics, int first_index, int num_children, const PUCTKernelParameter& parameter, int start = 0, PUCTKernelResult result = PUCTKernelResult())
+{
+    for (int i = start; i < num_children; ++i) {
+        int index = first_index + i;
+        updateResult(result, i, statistics.policy_[index], statistics.count_[index], statistics.mean_[index], statistics.reward_[index], statistics.virtual_loss_[index], parameter);
+    }
+    return result;
+}
+
+#if PUCT_KERNEL_X86
+// reduce the per-lane bests into the result, and finish the remaining children with the scalar code
+PUCTKernelResult reduceLanes(const float* visited_score, const float* visited_policy, const float* visited_index,
+                             const float* unvisited_score, const float* unvisited_policy, const float* unvisited_index,
+                             const float* sum_of_visited_mean, const float* num_visited, int width)
+{
+    PUCTKernelResult result;
+    for (int lane = 0; lane < width; ++lane) {
+        mergeCandidate(visited_score[lane], visited_policy[lane], static_cast<int>(visited_index[lane]), result.best_visited_score_, result.best_visited_policy_, result.best_visited_index_);
+        mergeCandidate(unvisited_score[lane], unvisited_policy[lane], static_cast<int>(unvisited_index[lane]), result.best_unvisited_score_, result.best_unvisited_policy_, result.best_unvisited_index_);
+        result.sum_of_visited_mean_ += sum_of_visited_mean[lane];
+        result.num_visited_ += num_visited[lane];
+    }
+    return result;
+}
+
+__attribute__((target("avx2"))) PUCTKernelResult calculatePUCTKernelAVX2(const PUCTChildStatistics& statistics, int first_index, int num_children, const PUCTKernelParameter& parameter)
+{
+    const int kWidth = 8;
+    const int num_vectorized = num_children / kWidth * kWidth;
+    if (num_vectorized == 0) { return calculatePUCTKernelScalar(statistics, first_index, num_children, parameter); }
+
+    const __m256 zero = _mm256_setzero_ps();
+    const __m256 one = _mm256_set1_ps(1.0f);
+    const __m256 two = _mm256_set1_ps(2.0f);
+    const __m256 minus_one = _mm256_set1_ps(-1.0f);
+    const __m256 lowest = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+    const __m256 puct_bias = _mm256_set1_ps(parameter.puct_bias_);
+    const __m256 sqrt_total_simulation = _mm256_set1_ps(parameter.sqrt_total_simulation_);
+    const __m256 reward_discount = _mm256_set1_ps(parameter.reward_discount_);
+    const __m256 value_sign = _mm256_set1_ps(parameter.value_sign_);
+    const __m256 value_lower_bound = _mm256_set1_ps(parameter.value_lower_bound_);
+    const __m256 value_range = _mm256_set1_ps(parameter.value_upper_bound_ - parameter.value_lower_bound_);
+
+    __m256 best_visited_score = lowest, best_visited_policy = lowest, best_visited_index = minus_one;
+    __m256 best_unvisited_score = lowest, best_unvisited_policy = lowest, best_unvisited_index = minus_one;
+    __m256 sum_of_visited_mean = zero, num_visited = zero;
+    __m256 index = _mm256_setr_ps(0, 1, 2, 3, 4, 5, 6, 7);
+    const __m256 index_step = _mm256_set1_ps(kWidth);
+    for (int i = 0; i < num_vectorized; i += kWidth, index = _mm256_add_ps(index, index_step)) {
+        const __m256 policy = _mm256_loadu_ps(&statistics.policy_[first_index + i]);
+        const __m256 count = _mm256_loadu_ps(&statistics.count_[first_index + i]);
+        const __m256 virtual_loss = _mm256_loadu_ps(&statistics.virtual_loss_[first_index + i]);
+        const __m256 count_with_virtual_loss = _mm256_add_ps(count, virtual_loss);
+        const __m256 value_u = _mm256_div_ps(_mm256_mul_ps(_mm256_mul_ps(puct_bias, policy), sqrt_total_simulation), _mm256_add_ps(one, count_with_virtual_loss));
+
+        __m256 value = _mm256_add_ps(_mm256_loadu_ps(&statistics.reward_[first_index + i]), _mm256_mul_ps(reward_discount, _mm256_loadu_ps(&statistics.mean_[first_index + i])));
+        if (parameter.value_rescale_) {
+            value = _mm256_div_ps(_mm256_sub_ps(value, value_lower_bound), value_range);
+            value = _mm256_min_ps(one, _mm256_max_ps(minus_one, _mm256_sub_ps(_mm256_mul_ps(two, value), one)));
+        }
+        value = _mm256_mul_ps(value, value_sign);
+        __m256 value_q = _mm256_div_ps(_mm256_sub_ps(_mm256_mul_ps(value, count), virtual_loss), count_with_virtual_loss);
+        if (parameter.value_rescale_ && !parameter.has_value_bound_) { value_q = one; }
+        const __m256 visited = _mm256_cmp_ps(count_with_virtual_loss, zero, _CMP_NEQ_OQ);
+        sum_of_visited_mean = _mm256_add_ps(sum_of_visited_mean, _mm256_and_ps(visited, value_q));
+        num_visited = _mm256_add_ps(num_visited, _mm256_and_ps(visited, one));
+
+        const __m256 score = _mm256_add_ps(value_u, value_q);
+        const __m256 visited_better = _mm256_and_ps(visited, _mm256_or_ps(_mm256_cmp_ps(score, best_visited_score, _CMP_GT_OQ),
+                                                                          _mm256_and_ps(_mm256_cmp_ps(score, best_visited_score, _CMP_EQ_OQ), _mm256_cmp_ps(policy, best_visited_policy, _CMP_GT_OQ))));
+        best_visited_score = _mm256_blendv_ps(best_visited_score, score, visited_better);
+        best_visited_policy = _mm256_blendv_ps(best_visited_policy, policy, visited_better);
+        best_visited_index = _mm256_blendv_ps(best_visited_index, index, visited_better);
+
+        const __m256 unvisited_better = _mm256_andnot_ps(visited, _mm256_or_ps(_mm256_cmp_ps(value_u, best_unvisited_score, _CMP_GT_OQ),
+                                                                               _mm256_and_ps(_mm256_cmp_ps(value_u, best_unvisited_score, _CMP_EQ_OQ), _mm256_cmp_ps(policy, best_unvisited_policy, _CMP_GT_OQ))));
+        best_unvisited_score = _mm256_blendv_ps(best_unvisited_score, value_u, unvisited_better);
+        best_unvisited_policy = _mm256_blendv_ps(best_unvisited_policy, policy, unvisited_better);
+        best_unvisited_index = _mm256_blendv_ps(best_unvisited_index, index, unvisited_better);
+    }
+
+    float lanes[8][kWidth];
+    _mm256_storeu_ps(lanes[0], best_visited_score);
+    _mm256_storeu_ps(lanes[1], best_visited_policy);
+    _mm256_storeu_ps(lanes[2], best_visited_index);
+    _mm256_storeu_ps(lanes[3], best_unvisited_score);
+    _mm256_storeu_ps(lanes[4], best_unvisited_policy);
+    _mm256_storeu_ps(lanes[5], best_unvisited_index);
+    _mm256_storeu_ps(lanes[6], sum_of_visited_mean);
+    _mm256_storeu_ps(lanes[7], num_visited);
+    PUCTKernelResult result = reduceLanes(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6], lanes[7], kWidth);
+    return calculatePUCTKernelScalar(statistics, first_index, num_children, parameter, num_vectorized, result);
+}
+
+__attribute__((target("avx512f"))) PUCTKernelResult calculatePUCTKernelAVX512(const PUCTChildStatistics& statistics, int first_index, int num_children, const PUCTKernelParameter& parameter)
+{
+    const int kWidth = 16;
+    const int num_vectorized = num_children / kWidth * kWidth;
+    if (num_vectorized == 0) { return calculatePUCTKernelAVX2(statistics, first_index, num_children, parameter); }
+
+    const __m512 zero = _mm512_setzero_ps();
+    const __m512 one = _mm512_set1_ps(1.0f);
+    const __m512 two = _mm512_set1_ps(2.0f);
+    const __m512 minus_one = _mm512_set1_ps(-1.0f);
+    const __m512 lowest = _mm512_set1_ps(std::numeric_limits<float>::lowest());
+    const __m512 puct_bias = _mm512_set1_ps(parameter.puct_bias_);
+    const __m512 sqrt_total_simulation = _mm512_set1_ps(parameter.sqrt_total_simulation_);
+    const __m512 reward_discount = _mm512_set1_ps(parameter.reward_discount_);
+    const __m512 value_sign = _mm512_set1_ps(parameter.value_sign_);
+    const __m512 value_lower_bound = _mm512_set1_ps(parameter.value_lower_bound_);
+    const __m512 value_range = _mm512_set1_ps(parameter.value_upper_bound_ - parameter.value_lower_bound_);
+
+    __m512 best_visited_score = lowest, best_visited_policy = lowest, best_visited_index = minus_one;
+    __m512 best_unvisited_score = lowest, best_unvisited_policy = lowest, best_unvisited_index = minus_one;
+    __m512 sum_of_visited_mean = zero, num_visited = zero;
+    __m512 index = _mm512_setr_ps(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+    const __m512 index_step = _mm512_set1_ps(kWidth);
+    for (int i = 0; i < num_vectorized; i += kWidth, index = _mm512_add_ps(index, index_step)) {
+        const __m512 policy = _mm512_loadu_ps(&statistics.policy_[first_index + i]);
+        const __m512 count = _mm512_loadu_ps(&statistics.count_[first_index + i]);
+        const __m512 virtual_loss = _mm512_loadu_ps(&statistics.virtual_loss_[first_index + i]);
+        const __m512 count_with_virtual_loss = _mm512_add_ps(count, virtual_loss);
+        const __m512 value_u = _mm512_div_ps(_mm512_mul_ps(_mm512_mul_ps(puct_bias, policy), sqrt_total_simulation), _mm512_add_ps(one, count_with_virtual_loss));
+
+        __m512 value = _mm512_add_ps(_mm512_loadu_ps(&statistics.reward_[first_index + i]), _mm512_mul_ps(reward_discount, _mm512_loadu_ps(&statistics.mean_[first_index + i])));
+        if (parameter.value_rescale_) {
+            value = _mm512_div_ps(_mm512_sub_ps(value, value_lower_bound), value_range);
+            // clamp by compare and blend, _mm512_min_ps/_mm512_max_ps pass an undefined vector to the masked builtins, which gcc 12 warns about
+            value = _mm512_sub_ps(_mm512_mul_ps(two, value), one);
+            value = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(value, minus_one, _CMP_LT_OQ), value, minus_one);
+            value = _mm512_mask_blend_ps(_mm512_cmp_ps_mask(value, one, _CMP_GT_OQ), value, one);
+        }
+        value = _mm512_mul_ps(value, value_sign);
+        __m512 value_q = _mm512_div_ps(_mm512_sub_ps(_mm512_mul_ps(value, count), virtual_loss), count_with_virtual_loss);
+        if (parameter.value_rescale_ && !parameter.has_value_bound_) { value_q = one; }
+        const __mmask16 visited = _mm512_cmp_ps_mask(count_with_virtual_loss, zero, _CMP_NEQ_OQ);
+        sum_of_visited_mean = _mm512_mask_add_ps(sum_of_visited_mean, visited, sum_of_visited_mean, value_q);
+        num_visited = _mm512_mask_add_ps(num_visited, visited, num_visited, one);
+
+        const __m512 score = _mm512_add_ps(value_u, value_q);
+        const __mmask16 visited_better = visited & (_mm512_cmp_ps_mask(score, best_visited_score, _CMP_GT_OQ)
+                                                    | (_mm512_cmp_ps_mask(score, best_visited_score, _CMP_EQ_OQ) & _mm512_cmp_ps_mask(policy, best_visited_policy, _CMP_GT_OQ)));
+        best_visited_score = _mm512_mask_blend_ps(visited_better, best_visited_score, score);
+        best_visited_policy = _mm512_mask_blend_ps(visited_better, best_visited_policy, policy);
+        best_visited_index = _mm512_mask_blend_ps(visited_better, best_visited_index, index);
+
+        const __mmask16 unvisited_better = ~visited & (_mm512_cmp_ps_mask(value_u, best_unvisited_score, _CMP_GT_OQ)
+                                                       | (_mm512_cmp_ps_mask(value_u, best_unvisited_score, _CMP_EQ_OQ) & _mm512_cmp_ps_mask(policy, best_unvisited_policy, _CMP_GT_OQ)));
+        best_unvisited_score = _mm512_mask_blend_ps(unvisited_better, best_unvisited_score, value_u);
+        best_unvisited_policy = _mm512_mask_blend_ps(unvisited_better, best_unvisited_policy, policy);
+        best_unvisited_index = _mm512_mask_blend_ps(unvisited_better, best_unvisited_index, index);
+    }
+
+    float lanes[8][kWidth];
+    _mm512_storeu_ps(lanes[0], best_visited_score);
+    _mm512_storeu_ps(lanes[1], best_visited_policy);
+    _mm512_storeu_ps(lanes[2], best_visited_index);
+    _mm512_storeu_ps(lanes[3], best_unvisited_score);
+    _mm512_storeu_ps(lanes[4], best_unvisited_policy);
+    _mm512_storeu_ps(lanes[5], best_unvisited_index);
+    _mm512_storeu_ps(lanes[6], sum_of_visited_mean);
+    _mm512_storeu_ps(lanes[7], num_visited);
+    PUCTKernelResult result = reduceLanes(lanes[0], lanes[1], lanes[2], lanes[3], lanes[4], lanes[5], lanes[6], lanes[7], kWidth);
+    return calculatePUCTKernelScalar(statistics, first_index, num_children, parameter, num_vectorized, result);
+}
+#endif
+
+typedef PUCTKernelResult (*PUCTKernelFunction)(const PUCTChildStatistics&, int, int, const PUCTKernelParameter&);
+
+std::pair<PUCTKernelFunction, const char*> selectPUCTKernel()
+{
+    // dispatch once by the instruction sets supported by the running cpu
+#if PUCT_KERNEL_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) { return {calculatePUCTKernelAVX512, "avx512"}; }
+    if (__builtin_cpu_supports("avx2")) { return {calculatePUCTKernelAVX2, "avx2"}; }
+#endif
+    return {[](const PUCTChildStatistics& statistics, int first_index, int num_children, const PUCTKernelParameter& parameter) { return calculatePUCTKernelScalar(statistics, first_index, num_children, parameter); }, "scalar"};
+}
+
+const std::pair<PUCTKernelFunction, const char*>& getPUCTKernel()
+{
+    static const std::pair<PUCTKernelFunction, const char*> kernel = selectPUCTKernel();
+    return kernel;
+}
+
+} // namespace
+
+int PUCTKernelResult::getSelectedIndex(float init_q_value) const
+{
+    if (best_unvisited_index_ < 0) { return best_visited_index_; }
+
+    // all unvisited children share the same init Q value, so only the one with the largest U value can be selected
+    float best_score = best_visited_score_, best_policy = best_visited_policy_;
+    int best_index = best_visited_index_;
+    mergeCandidate(best_unvisited_score_ + init_q_value, best_unvisited_policy_, best_unvisited_index_, best_score, best_policy, best_index);
+    return best_index;
+}
+
+PUCTKernelResult calculatePUCTKernel(const PUCTChildStatistics& statistics, int first_index, int num_children, const PUCTKernelParameter& parameter)
+{
+    assert(first_index >= 0 && first_index + num_children <= static_cast<int>(statistics.size()));
+    return getPUCTKernel().first(statistics, first_index, num_children, parameter);
+}
+
+const char* getPUCTKernelName() { return getPUCTKernel().second; }
+
+} // namespace minizero::actor
@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstddef>
+#include <limits>
+#include <vector>
+
+namespace minizero::actor {
+
+// the statistics of tree nodes in structure-of-arrays layout, indexed by the node index in the tree
+// since siblings are allocated contiguously, the children of a node occupy a contiguous range of each array
+class PUCTChildStatistics {
+public:
+    inline void resize(size_t size)
+    {
+        policy_.resize(size);
+        count_.resize(size);
+        mean_.resize(size);
+        reward_.resize(size);
+        virtual_loss_.resize(size);
+    }
+    inline size_t size() const { return policy_.size(); }
+
+    std::vector<float> policy_;
+    std::vector<float> count_;
+    std::vector<float> mean_;
+    std::vector<float> reward_;
+    std::vector<float> virtual_loss_;
+};
+
+// the per-selection constants of the PUCT formula and value normalization, computed once for all children
+class PUCTKernelParameter {
+public:
+    float puct_bias_;
+    float sqrt_total_simulation_;
+    float reward_discount_;
+    float value_sign_;
+    bool value_rescale_;
+    bool has_value_bound_;
+    float value_lower_bound_;
+    float value_upper_bound_;
+};
+
+// the single-pass result over the children: the best visited child, the best unvisited child (whose Q value is not known yet),
+// and the sum of normalized means of visited children for calculating the init Q value
+class PUCTKernelResult {
+public:
+    PUCTKernelResult()
+        : best_visited_score_(std::numeric_limits<float>::lowest()),
+          best_visited_policy_(std::numeric_limits<float>::lowest()),
+          best_visited_index_(-1),
+          best_unvisited_score_(std::numeric_limits<float>::lowest()),
+          best_unvisited_policy_(std::numeric_limits<float>::lowest()),
+          best_unvisited_index_(-1),
+          sum_of_visited_mean_(0.0f),
+          num_visited_(0.0f) {}
+
+    int getSelectedIndex(float init_q_value) const;
+
+    float best_visited_score_;
+    float best_visited_policy_;
+    int best_visited_index_;
+    float best_unvisited_score_;
+    float best_unvisited_policy_;
+    int best_unvisited_index_;
+    float sum_of_visited_mean_;
+    float num_visited_;
+};
+
+// scores children [first_index, first_index + num_children) with AVX-512, AVX2, or scalar code depending on the cpu
+PUCTKernelResult calculatePUCTKernel(const PUCTChildStatistics& statistics, int first_index, int num_children, const PUCTKernelParameter& parameter);
+const char* getPUCTKernelName();
+
+} // namespace minizero::actor
@@ -1,11 +1,20 @@
 #pragma once
 
+#include <atomic>
 #include <cassert>
+#include <cstdint>
+#include <cstdlib>
+#include <mutex>
+#include <sstream>
 #include <string>
+#include <unordered_map>
+#include <utility>
 #include <vector>
 
 namespace minizero::actor {
 
+class Tree;
+
 template <class Data>
 class TreeData {
 public:
@@ -18,11 +27,22 @@ public:
         data_.push_back(data);
         return index;
     }
+    inline int store(Data&& data)
+    {
+        int index = data_.size();
+        data_.push_back(std::move(data));
+        return index;
+    }
     inline const Data& getData(int index) const
     {
         assert(index >= 0 && index < size());
         return data_[index];
     }
+    inline Data& getData(int index)
+    {
+        assert(index >= 0 && index < size());
+        return data_[index];
+    }
     inline int size() const { return data_.size(); }
 
 private:
@@ -52,53 +72,144 @@ protected:
     TreeNode* first_child_;
 };
 
+// a process-wide pool of fixed-size memory blocks for tree nodes
+// trees grow by acquiring blocks on demand and give them back on reset, so the memory tracks the nodes actually expanded
+class TreeNodeBlockPool {
+public:
+    // blocks are aligned to their size, so the block (and its header) of any node can be found from the node address
+    static constexpr size_t kBlockBytes = 1 << 18;
+    static constexpr size_t kHeaderBytes = 64;
+
+    class BlockHeader {
+    public:
+        uint64_t block_id_; // the block order in the tree owning this block
+        Tree* tree_;
+    };
+
+    static TreeNodeBlockPool& getInstance()
+    {
+        static TreeNodeBlockPool pool;
+        return pool;
+    }
+
+    inline void* acquire()
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        void* block = nullptr;
+        if (free_blocks_.empty()) {
+            block = std::aligned_alloc(kBlockBytes, kBlockBytes);
+            assert(block);
+            ++num_allocated_blocks_;
+        } else {
+            block = free_blocks_.back();
+            free_blocks_.pop_back();
+        }
+        size_t num_used_blocks = ++num_used_blocks_;
+        if (num_used_blocks > peak_num_used_blocks_) { peak_num_used_blocks_ = num_used_blocks; }
+        return block;
+    }
+
+    inline void release(void* block)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert(num_used_blocks_ > 0);
+        free_blocks_.push_back(block);
+        --num_used_blocks_;
+    }
+
+    static inline BlockHeader* getBlockHeader(const void* node) { return reinterpret_cast<BlockHeader*>(reinterpret_cast<uintptr_t>(node) & ~(kBlockBytes - 1)); }
+
+    inline size_t getUsedBytes() const { return num_used_blocks_ * kBlockBytes; }
+    inline size_t getPeakUsedBytes() const { return peak_num_used_blocks_ * kBlockBytes; }
+    inline size_t getAllocatedBytes() const { return num_allocated_blocks_ * kBlockBytes; }
+
+private:
+    TreeNodeBlockPool()
+        : num_allocated_blocks_(0),
+          num_used_blocks_(0),
+          peak_num_used_blocks_(0) {}
+
+    ~TreeNodeBlockPool()
+    {
+        for (void* block : free_blocks_) { std::free(block); }
+    }
+
+    std::mutex mutex_;
+    std::vector<void*> free_blocks_;
+    std::atomic<size_t> num_allocated_blocks_;
+    std::atomic<size_t> num_used_blocks_;
+    std::atomic<size_t> peak_num_used_blocks_;
+};
+
 class Tree {
 public:
-    Tree(uint64_t tree_node_size)
+    Tree(uint64_t tree_node_size, size_t tree_node_bytes)
         : tree_node_size_(tree_node_size),
-          nodes_(nullptr)
+          tree_node_bytes_(tree_node_bytes),
+          num_nodes_per_block_((TreeNodeBlockPool::kBlockBytes - TreeNodeBlockPool::kHeaderBytes) / tree_node_bytes),
+          root_(nullptr)
+    {
+        assert(tree_node_size >= 0 && num_nodes_per_block_ > 0);
+    }
+
+    virtual ~Tree()
     {
-        assert(tree_node_size >= 0);
+        for (void* block : blocks_) { TreeNodeBlockPool::getInstance().release(block); }
     }
 
     inline void reset()
     {
-        if (!nodes_) { nodes_ = createTreeNodes(1 + tree_node_size_); }
-        current_node_size_ = 1;
-        getRootNode()->reset();
+        while (blocks_.size() > 1) {
+            TreeNodeBlockPool::getInstance().release(blocks_.back());
+            blocks_.pop_back();
+        }
+        current_node_size_ = 0;
+        num_nodes_ = 0;
+        side_values_.clear();
+        root_ = allocateNodeMemory(1);
     }
 
-    inline TreeNode* allocateNodes(int size)
+    // the index of a node in the tree; sibling nodes have consecutive indices
+    inline uint64_t getNodeIndex(const void* node) const
     {
-        assert(current_node_size_ + size <= 1 + tree_node_size_);
-        TreeNode* node = getNodeIndex(current_node_size_);
-        current_node_size_ += size;
-        return node;
+        const TreeNodeBlockPool::BlockHeader* header = TreeNodeBlockPool::getBlockHeader(node);
+        uint64_t offset = (reinterpret_cast<const char*>(node) - reinterpret_cast<const char*>(header) - TreeNodeBlockPool::kHeaderBytes) / tree_node_bytes_;
+        return header->block_id_ * num_nodes_per_block_ + offset;
+    }
+    inline void* getNodeAddress(uint64_t index) const
+    {
+        assert(index < getNodeCapacity());
+        return static_cast<char*>(blocks_[index / num_nodes_per_block_]) + TreeNodeBlockPool::kHeaderBytes + (index % num_nodes_per_block_) * tree_node_bytes_;
     }
+    inline uint64_t getNodeCapacity() const { return blocks_.size() * num_nodes_per_block_; }
+    inline uint64_t getNumNodes() const { return num_nodes_; }
+    inline size_t getTreeNodeBytes() const { return tree_node_bytes_; }
 
-    std::string toString(const std::string& env_string)
+    // rarely used node values that compact nodes keep out of their layout, keyed by the node index
+    inline void setSideValue(const void* node, float value) { side_values_[getNodeIndex(node)] = value; }
+    inline float getSideValue(const void* node) const
     {
-        assert(!env_string.empty() && env_string.back() == ')');
-        std::ostringstream oss;
-        TreeNode* pRoot = getRootNode();
-        std::string env_prefix = env_string.substr(0, env_string.size() - 1);
-        oss << env_prefix << "C[" << pRoot->toString() << "]" << getTreeInfo_r(pRoot) << ")";
-        return oss.str();
+        auto it = side_values_.find(getNodeIndex(node));
+        return (it == side_values_.end() ? 0.0f : it->second);
     }
 
-    std::string getTreeInfo_r(const TreeNode* node) const
+    // the tree owning a node, for nodes referring to their children by indices
+    static inline Tree* getTree(const void* node) { return TreeNodeBlockPool::getBlockHeader(node)->tree_; }
+
+    template <class Node>
+    std::string getTreeInfo_r(const Node* node) const
     {
         std::ostringstream oss;
 
         int numChildren = 0;
         for (int i = 0; i < node->getNumChildren(); ++i) {
-            TreeNode* child = node->getChild(i);
+            const Node* child = node->getChild(i);
             if (child->isLeaf()) { continue; }
             ++numChildren;
         }
 
         for (int i = 0; i < node->getNumChildren(); ++i) {
-            TreeNode* child = node->getChild(i);
+            const Node* child = node->getChild(i);
             if (!child->displayInTreeLog()) { continue; }
             if (numChildren > 1) { oss << "("; }
             oss << playerToChar(child->getAction().getPlayer())
@@ -109,16 +220,33 @@ public:
         return oss.str();
     }
 
-    inline TreeNode* getRootNode() { return &nodes_[0]; }
-    inline const TreeNode* getRootNode() const { return &nodes_[0]; }
-
 protected:
-    virtual TreeNode* createTreeNodes(uint64_t tree_node_size) = 0;
-    virtual TreeNode* getNodeIndex(int index) = 0;
+    inline void* allocateNodeMemory(int size)
+    {
+        // sibling nodes must be contiguous, skip the rest of the current block if they do not fit in
+        assert(size > 0 && static_cast<uint64_t>(size) <= num_nodes_per_block_ && num_nodes_ + size <= 1 + tree_node_size_);
+        uint64_t offset = current_node_size_ % num_nodes_per_block_;
+        if (offset + size > num_nodes_per_block_) { current_node_size_ += num_nodes_per_block_ - offset; }
+        while (current_node_size_ + size > getNodeCapacity()) {
+            TreeNodeBlockPool::BlockHeader* header = static_cast<TreeNodeBlockPool::BlockHeader*>(TreeNodeBlockPool::getInstance().acquire());
+            header->block_id_ = blocks_.size();
+            header->tree_ = this;
+            blocks_.push_back(header);
+        }
+        void* memory = getNodeAddress(current_node_size_);
+        current_node_size_ += size;
+        num_nodes_ += size;
+        return memory;
+    }
 
     uint64_t tree_node_size_;
+    size_t tree_node_bytes_;
+    uint64_t num_nodes_per_block_;
     uint64_t current_node_size_;
-    TreeNode* nodes_;
+    uint64_t num_nodes_;
+    std::vector<void*> blocks_;
+    std::unordered_map<uint64_t, float> side_values_;
+    void* root_;
 };
 
 } // namespace minizero::actor
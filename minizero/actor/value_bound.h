@@ -0,0 +1,80 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <unordered_map>
+
+namespace minizero::actor {
+
+// the multiset of node values in the tree, keeping only what value rescaling needs: the minimum and the maximum
+// values are counted in a hash map, and the bounds are cached and recounted lazily only when the last copy of a bound is removed
+class ValueBound {
+public:
+    ValueBound() { clear(); }
+
+    inline void clear()
+    {
+        value_count_.clear();
+        lower_bound_ = upper_bound_ = 0.0f;
+        need_recount_ = false;
+    }
+
+    inline void add(float value)
+    {
+        if (value_count_.empty()) {
+            lower_bound_ = upper_bound_ = value;
+        } else if (!need_recount_) {
+            lower_bound_ = std::min(lower_bound_, value);
+            upper_bound_ = std::max(upper_bound_, value);
+        }
+        ++value_count_[value];
+    }
+
+    inline void update(float old_value, float new_value)
+    {
+        // the old value is removed only if it exists, i.e., the same as updating a std::map<float, int> counter
+        auto it = value_count_.find(old_value);
+        if (it != value_count_.end()) {
+            assert(it->second > 0);
+            if (--it->second == 0) {
+                value_count_.erase(it);
+                // recount only if the removed bound is not replaced by the new value
+                if ((old_value == lower_bound_ && new_value > old_value) || (old_value == upper_bound_ && new_value < old_value)) { need_recount_ = true; }
+            }
+        }
+        add(new_value);
+    }
+
+    // no bound is available if there are fewer than two different values, where lower bound equals upper bound
+    inline bool hasBound() const { return getUpperBound() > getLowerBound(); }
+    inline float getLowerBound() const
+    {
+        recount();
+        return lower_bound_;
+    }
+    inline float getUpperBound() const
+    {
+        recount();
+        return upper_bound_;
+    }
+    inline int size() const { return value_count_.size(); }
+
+private:
+    inline void recount() const
+    {
+        if (!need_recount_) { return; }
+        need_recount_ = false;
+        lower_bound_ = upper_bound_ = (value_count_.empty() ? 0.0f : value_count_.begin()->first);
+        for (const auto& value : value_count_) {
+            lower_bound_ = std::min(lower_bound_, value.first);
+            upper_bound_ = std::max(upper_bound_, value.first);
+        }
+    }
+
+    std::unordered_map<float, int> value_count_;
+    mutable float lower_bound_;
+    mutable float upper_bound_;
+    mutable bool need_recount_;
+};
+
+} // namespace minizero::actor
@@ -1,10 +1,16 @@
 #include "zero_actor.h"
+#include "create_network.h"
 #include "random.h"
+#include "thread_pool.h"
 #include "time_system.h"
 #include <algorithm>
+#include <iostream>
 #include <memory>
+#include <mutex>
+#include <random>
 #include <tuple>
 #include <unordered_map>
+#include <unordered_set>
 #include <utility>
 #include <vector>
 
@@ -16,6 +22,11 @@ using namespace network;
 void MCTSSearchData::clear()
 {
     search_info_ = "";
+    num_reused_simulation_ = 0;
+    num_evaluation_cache_hits_ = 0;
+    num_batches_ = num_batch_leaves_ = num_batch_collisions_ = 0;
+    num_think_threads_ = 0;
+    num_env_transition_copies_ = 0;
     selected_node_ = nullptr;
     node_path_.clear();
 }
@@ -28,21 +39,50 @@ void ZeroActor::reset()
 
 void ZeroActor::resetSearch()
 {
-    BaseActor::resetSearch();
+    MCTSNode* reusable_node = findReusableNode();
+    if (reusable_node) {
+        nn_evaluation_batch_id_ = -1;
+        getMCTS()->reuseSubtree(reusable_node);
+        addNoiseToNodeChildren(getMCTS()->getRootNode());
+    } else {
+        BaseActor::resetSearch();
+    }
+    mcts_search_data_.num_reused_simulation_ = getMCTS()->getNumSimulation();
+    mcts_search_data_.num_evaluation_cache_hits_ = 0;
+    mcts_search_data_.num_batches_ = mcts_search_data_.num_batch_leaves_ = mcts_search_data_.num_batch_collisions_ = 0;
+    mcts_search_data_.num_think_threads_ = 0;
+    mcts_search_data_.num_env_transition_copies_ = 0;
+    mcts_search_data_.selected_node_ = nullptr; // the previous one may be compacted away with the reused tree
     mcts_search_data_.node_path_.clear();
+    early_stop_ratio_ = config::actor_mcts_early_stop_ratio;
+    env_transition_path_.clear(); // the root environment or the tree may have changed
+    releaseHiddenStateSlots();
     getMCTS()->getRootNode()->setAction(Action(-1, env::getPreviousPlayer(env_.getTurn(), env_.getNumPlayer())));
+    tree_root_num_actions_ = env_.getActionHistory().size();
 }
 
 Action ZeroActor::think(bool with_play /*= false*/, bool display_board /*= false*/)
 {
     resetSearch();
+    early_stop_ratio_ = config::actor_mcts_think_early_stop_ratio;
     boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
-    while (!isSearchDone()) {
-        step();
-        int spent_million_second = (utils::TimeSystem::getLocalTime() - start_ptime).total_milliseconds();
-        if (config::actor_mcts_think_time_limit > 0 && spent_million_second >= config::actor_mcts_think_time_limit * 1000) { break; }
+    if (useParallelThink()) {
+        static std::once_flag warning_flag;
+        std::call_once(warning_flag, []() { std::cerr << "[warning] actor_mcts_think_num_threads > 1, the search results are not deterministic" << std::endl; });
+        if (getMCTS()->getNumSimulation() == 0) { step(); } // expand the root (and add noise) before the workers start
+        if (!isSearchDone()) {
+            parallelThink(start_ptime);
+            handleSearchDone();
+        }
+    } else {
+        while (!isSearchDone()) {
+            step();
+            int spent_million_second = (utils::TimeSystem::getLocalTime() - start_ptime).total_milliseconds();
+            if (config::actor_mcts_think_time_limit > 0 && spent_million_second >= config::actor_mcts_think_time_limit * 1000) { break; }
+        }
     }
-    if (!isSearchDone()) { handleSearchDone(); }
+    // the search may stop before deciding the action, e.g., by the time limit or on a reused root that is already settled
+    if (!mcts_search_data_.selected_node_) { handleSearchDone(); }
     if (with_play) { act(getSearchAction()); }
     if (display_board) { std::cerr << env_.toString() << mcts_search_data_.search_info_ << std::endl; }
     return getSearchAction();
@@ -50,21 +90,69 @@ Action ZeroActor::think(bool with_play /*= false*/, bool display_board /*= false
 
 void ZeroActor::beforeNNEvaluation()
 {
-    mcts_search_data_.node_path_ = selection();
-    if (alphazero_network_) {
-        Environment env_transition = getEnvironmentTransition(mcts_search_data_.node_path_);
+    // a reused root may already be proven (or settled), whose action is decided without evaluating any leaf
+    if (!mcts_search_data_.selected_node_ && isSearchDone()) {
+        nn_evaluation_batch_id_ = -1;
+        handleSearchDone();
+        return;
+    }
+    if (!selectNNEvaluationLeaf()) {
+        nn_evaluation_batch_id_ = -1;
+        return;
+    }
+    allocateNNEvaluationInput();
+}
+
+bool ZeroActor::selectNNEvaluationLeaf()
+{
+    // leaves found in the evaluation cache are expanded immediately, until a leaf needs the network or the search is done
+    while (true) {
+        // a batch stops at the end of a gumbel phase, whose candidates are only decided after all of its visits are backed up
+        if (config::actor_use_gumbel && getMCTS()->getNumSimulation() > 0 && gumbel_zero_.getNumPhaseSimulationsLeft() == 0) { return false; }
+        mcts_search_data_.node_path_ = selection();
+        if (!alphazero_network_) { return true; }
+        if (backupProvenLeaf(mcts_search_data_.node_path_)) {
+            if (isSearchDone()) {
+                handleSearchDone();
+                return false;
+            }
+            continue;
+        }
+        if (config::actor_mcts_chance_node) { selectChanceEvent(mcts_search_data_.node_path_); }
+        const Environment& env_transition = getEnvironmentTransition(mcts_search_data_.node_path_);
         feature_rotation_ = config::actor_use_random_rotation_features ? static_cast<utils::Rotation>(utils::Random::randInt() % static_cast<int>(utils::Rotation::kRotateSize)) : utils::Rotation::kRotationNone;
-        nn_evaluation_batch_id_ = alphazero_network_->pushBack(env_transition.getFeatures(feature_rotation_));
+        if (!alphazero_network_->getEvaluationCache().isEnabled() || !evaluateFromCache(env_transition)) { return true; }
+        if (isSearchDone()) { return false; }
+    }
+}
+
+void ZeroActor::allocateNNEvaluationInput()
+{
+    if (alphazero_network_) {
+        std::pair<int, float*> input = alphazero_network_->allocateInput();
+        if (alphazero_network_->getEvaluationCache().isEnabled()) {
+            std::copy(cache_features_.begin(), cache_features_.end(), input.second);
+        } else {
+            getEnvironmentTransition(mcts_search_data_.node_path_).getFeaturesInto(input.second, feature_rotation_);
+        }
+        nn_evaluation_batch_id_ = input.first;
     } else if (muzero_network_) {
         if (getMCTS()->getNumSimulation() == 0) { // initial inference for root node
-            nn_evaluation_batch_id_ = muzero_network_->pushBackInitialData(env_.getFeatures());
+            std::pair<int, float*> input = muzero_network_->allocateInitialInput(acquireHiddenStateSlot());
+            env_.getFeaturesInto(input.second);
+            nn_evaluation_batch_id_ = input.first;
         } else { // for non-root nodes
             const std::vector<MCTSNode*>& node_path = mcts_search_data_.node_path_;
             MCTSNode* leaf_node = node_path.back();
             MCTSNode* parent_node = node_path[node_path.size() - 2];
             assert(parent_node && parent_node->getHiddenStateDataIndex() != -1);
-            const std::vector<float>& hidden_state = getMCTS()->getTreeHiddenStateData().getData(parent_node->getHiddenStateDataIndex()).hidden_state_;
-            nn_evaluation_batch_id_ = muzero_network_->pushBackRecurrentData(hidden_state, env_.getActionFeatures(leaf_node->getAction()));
+            if (muzero_network_->useHiddenStatePool()) {
+                nn_evaluation_batch_id_ = muzero_network_->allocateRecurrentInput(env_.getActionFeatures(leaf_node->getAction()), parent_node->getHiddenStateDataIndex(), acquireHiddenStateSlot());
+            } else {
+                std::pair<int, float*> input = muzero_network_->allocateRecurrentInput(env_.getActionFeatures(leaf_node->getAction()));
+                getMCTS()->getHiddenStateSlab().load(parent_node->getHiddenStateDataIndex(), input.second);
+                nn_evaluation_batch_id_ = input.first;
+            }
         }
     } else {
         assert(false);
@@ -76,19 +164,14 @@ void ZeroActor::afterNNEvaluation(const std::shared_ptr<NetworkOutput>& network_
     const std::vector<MCTSNode*>& node_path = mcts_search_data_.node_path_;
     MCTSNode* leaf_node = node_path.back();
     if (alphazero_network_) {
-        Environment env_transition = getEnvironmentTransition(node_path);
-        if (!env_transition.isTerminal()) {
-            std::shared_ptr<AlphaZeroNetworkOutput> alphazero_output = std::static_pointer_cast<AlphaZeroNetworkOutput>(network_output);
-            getMCTS()->expand(leaf_node, calculateAlphaZeroActionPolicy(env_transition, alphazero_output, feature_rotation_));
-            getMCTS()->backup(node_path, alphazero_output->value_, env_transition.getReward());
-        } else {
-            getMCTS()->backup(node_path, env_transition.getEvalScore(), env_transition.getReward());
-        }
+        const Environment& env_transition = getEnvironmentTransition(node_path);
+        if (!env_transition.isTerminal() && nn_evaluation_batch_id_ >= 0 && alphazero_network_->getEvaluationCache().isEnabled()) { alphazero_network_->getEvaluationCache().insert(evaluation_cache_key_, network_output->clone()); }
+        expandAndBackupAlphaZeroLeaf(node_path, env_transition, network_output, feature_rotation_);
     } else if (muzero_network_) {
         std::shared_ptr<MuZeroNetworkOutput> muzero_output = std::static_pointer_cast<MuZeroNetworkOutput>(network_output);
         getMCTS()->expand(leaf_node, calculateMuZeroActionPolicy(leaf_node, muzero_output));
         getMCTS()->backup(node_path, muzero_output->value_, muzero_output->reward_);
-        leaf_node->setHiddenStateDataIndex(getMCTS()->getTreeHiddenStateData().store(HiddenStateData(muzero_output->hidden_state_)));
+        leaf_node->setHiddenStateDataIndex(muzero_output->hidden_state_slot_ >= 0 ? muzero_output->hidden_state_slot_ : getMCTS()->getHiddenStateSlab().store(muzero_output->hidden_state_.data(), muzero_output->hidden_state_.size()));
     } else {
         assert(false);
     }
@@ -97,6 +180,16 @@ void ZeroActor::afterNNEvaluation(const std::shared_ptr<NetworkOutput>& network_
     if (config::actor_use_gumbel) { gumbel_zero_.sequentialHalving(getMCTS()); }
 }
 
+std::shared_ptr<Search> ZeroActor::createSearch()
+{
+    uint64_t tree_node_size = tree_node_size_;
+#if PUZZLE2048 || TETRISBLOCKPUZZLE
+    // each simulation may also add the chance events of one afterstate
+    if (config::actor_mcts_chance_node) { tree_node_size += static_cast<uint64_t>(config::actor_num_simulation + 1) * env_.getChanceEventSize(); }
+#endif
+    return std::make_shared<MCTS>(tree_node_size);
+}
+
 void ZeroActor::setNetwork(const std::shared_ptr<network::Network>& network)
 {
     assert(network);
@@ -110,6 +203,16 @@ void ZeroActor::setNetwork(const std::shared_ptr<network::Network>& network)
         assert(false);
     }
     assert((alphazero_network_ && !muzero_network_) || (!alphazero_network_ && muzero_network_));
+    inference_scheduler_ = nullptr;
+
+    // the evaluation cache is shared by all actors on the same network, size it once by the memory budget
+    if (alphazero_network_ && config::actor_evaluation_cache_memory_mb > 0 && !alphazero_network_->getEvaluationCache().isEnabled()) {
+        size_t entry_size = sizeof(AlphaZeroNetworkOutput) + 2 * alphazero_network_->getActionSize() * sizeof(float) + 128; // approximate overhead of the hash map and the clock
+        alphazero_network_->getEvaluationCache().reset(static_cast<size_t>(config::actor_evaluation_cache_memory_mb) * 1024 * 1024 / entry_size);
+    }
+
+    // each tree holds at most one hidden state per simulation, plus the leaves being evaluated
+    if (muzero_network_ && config::actor_mcts_device_hidden_state) { muzero_network_->reserveHiddenStateSlots(config::actor_num_simulation + config::actor_mcts_think_batch_size + 1); }
 }
 
 std::vector<std::pair<std::string, std::string>> ZeroActor::getActionInfo() const
@@ -133,26 +236,38 @@ void ZeroActor::step()
     int num_simulation_left = config::actor_num_simulation + 1 - num_simulation;
     int batch_size = std::min(config::actor_mcts_think_batch_size,
                               (alphazero_network_ || num_simulation > 0) ? num_simulation_left : 1 /* initial inference for root node */);
+    if (config::actor_use_gumbel && num_simulation > 0) { batch_size = std::min(batch_size, gumbel_zero_.getNumPhaseSimulationsLeft()); } // the visits of a whole phase are scheduled up front
     assert(batch_size > 0);
 
-    std::vector<std::tuple<int, utils::Rotation, decltype(mcts_search_data_.node_path_)>> batch_queries; // batch id, rotation, search path
-    for (int batch_id = 0; batch_id < batch_size; batch_id++) {
-        beforeNNEvaluation();
-        assert(nn_evaluation_batch_id_ == batch_id);
-        if (mcts_search_data_.node_path_.back()->getVirtualLoss() == 0) {
-            batch_queries.emplace_back(nn_evaluation_batch_id_, feature_rotation_, mcts_search_data_.node_path_);
+    // only unique leaves are pushed into the network, a selection reaching a leaf already in the batch is a collision
+    // its virtual loss is kept to steer the next selections away, until the batch is full or there are too many collisions
+    std::vector<std::tuple<int, utils::Rotation, decltype(mcts_search_data_.node_path_), EvaluationCacheKey>> batch_queries; // batch id, rotation, search path, evaluation cache key
+    int num_collisions = 0;
+    while (static_cast<int>(batch_queries.size()) < batch_size) {
+        if (!selectNNEvaluationLeaf()) { break; } // the search is done by leaves from the evaluation cache
+        getMCTS()->addVirtualLoss(mcts_search_data_.node_path_);
+        if (mcts_search_data_.node_path_.back()->getVirtualLoss() > 1) {
+            if (config::actor_use_gumbel) { gumbel_zero_.cancelSelection(getMCTS()); }
+            if (++num_collisions > config::actor_mcts_think_batch_max_collisions) { break; }
+            continue;
         }
-        for (auto node : mcts_search_data_.node_path_) { node->addVirtualLoss(); }
+        allocateNNEvaluationInput();
+        assert(nn_evaluation_batch_id_ == static_cast<int>(batch_queries.size()));
+        batch_queries.emplace_back(nn_evaluation_batch_id_, feature_rotation_, mcts_search_data_.node_path_, evaluation_cache_key_);
     }
+    mcts_search_data_.num_batch_collisions_ += num_collisions;
+    if (batch_queries.empty()) { return; }
+    ++mcts_search_data_.num_batches_;
+    mcts_search_data_.num_batch_leaves_ += batch_queries.size();
     auto network_output = alphazero_network_ ? alphazero_network_->forward()
                                              : (num_simulation == 0 ? muzero_network_->initialInference() : muzero_network_->recurrentInference());
     for (auto& query : batch_queries) {
         nn_evaluation_batch_id_ = std::get<0>(query);
         feature_rotation_ = std::get<1>(query);
         mcts_search_data_.node_path_ = std::get<2>(query);
+        evaluation_cache_key_ = std::get<3>(query);
         afterNNEvaluation(network_output[nn_evaluation_batch_id_]);
-        auto virtual_loss = mcts_search_data_.node_path_.back()->getVirtualLoss();
-        for (auto node : mcts_search_data_.node_path_) { node->removeVirtualLoss(virtual_loss); }
+        getMCTS()->removeVirtualLoss(mcts_search_data_.node_path_, mcts_search_data_.node_path_.back()->getVirtualLoss());
     }
 }
 
@@ -161,25 +276,89 @@ void ZeroActor::handleSearchDone()
     mcts_search_data_.selected_node_ = decideActionNode();
     const Action action = getSearchAction();
     std::ostringstream oss;
-    oss << "model file name: " << config::nn_file_name << std::endl
+    oss << "model file name: " << getNetworkFileName() << std::endl
         << utils::TimeSystem::getTimeString("[Y/m/d H:i:s.f] ")
         << "move number: " << env_.getActionHistory().size()
         << ", action: " << action.toConsoleString()
         << " (" << action.getActionID() << ")"
         << ", reward: " << env_.getReward()
         << ", player: " << env::playerToChar(action.getPlayer());
-    if (config::actor_mcts_value_rescale) { oss << ", value bound: (" << getMCTS()->getTreeValueBound().begin()->first << ", " << getMCTS()->getTreeValueBound().rbegin()->first << ")"; }
+    if (config::actor_mcts_reuse_tree) { oss << ", reused simulation: " << mcts_search_data_.num_reused_simulation_; }
+    if (alphazero_network_ && alphazero_network_->getEvaluationCache().isEnabled()) {
+        oss << ", evaluation cache hits: " << mcts_search_data_.num_evaluation_cache_hits_
+            << " (hit rate: " << alphazero_network_->getEvaluationCache().getHitRate() * 100 << "%)";
+    }
+    if (mcts_search_data_.num_think_threads_ > 1) {
+        float seconds = (utils::TimeSystem::getLocalTime() - parallel_think_data_.start_ptime_).total_microseconds() / 1000000.0f;
+        oss << ", think threads: " << mcts_search_data_.num_think_threads_
+            << ", simulations/s: " << (getMCTS()->getNumSimulation() - mcts_search_data_.num_reused_simulation_) / std::max(seconds, 1e-6f);
+        if (inference_scheduler_) { oss << ", inference scheduler: {" << inference_scheduler_->getStatistics() << "}"; }
+    }
+    if (config::actor_mcts_think_batch_size > 1 && mcts_search_data_.num_batches_ > 0) {
+        oss << ", batch collisions: " << mcts_search_data_.num_batch_collisions_
+            << ", effective batch size: " << static_cast<float>(mcts_search_data_.num_batch_leaves_) / mcts_search_data_.num_batches_;
+    }
+    if (alphazero_network_ && !env_.supportUndo()) {
+        // environments without undo copy the root environment whenever the selection path diverges from the previous one
+        oss << ", environment copies per simulation: " << static_cast<float>(mcts_search_data_.num_env_transition_copies_) / std::max(1, getMCTS()->getNumSimulation() - mcts_search_data_.num_reused_simulation_);
+    }
+    if (!getMCTS()->reachMaximumSimulation() && isSearchSettled()) { oss << ", early stop saved simulation: " << config::actor_num_simulation + 1 - getMCTS()->getNumSimulation(); }
+    if (config::actor_mcts_value_rescale) { oss << ", value bound: (" << getMCTS()->getTreeValueBound().getLowerBound() << ", " << getMCTS()->getTreeValueBound().getUpperBound() << ")"; }
     oss << std::endl
         << "  root node info: " << getMCTS()->getRootNode()->toString() << std::endl
         << "action node info: " << mcts_search_data_.selected_node_->toString() << std::endl;
     mcts_search_data_.search_info_ = oss.str();
 }
 
+bool ZeroActor::evaluateFromCache(const Environment& env_transition)
+{
+    // features are written to a reusable buffer first, so a cache hit does not occupy a batch slot
+    cache_features_.resize(alphazero_network_->getInputSize());
+    env_transition.getFeaturesInto(cache_features_.data(), feature_rotation_);
+    evaluation_cache_key_ = EvaluationCache::hashFeatures(cache_features_.data(), cache_features_.size());
+
+    // skip leaves already waiting for the network in the same batch, otherwise they would be expanded twice
+    if (mcts_search_data_.node_path_.back()->getVirtualLoss() > 0) { return false; }
+    std::shared_ptr<NetworkOutput> cached_output = alphazero_network_->getEvaluationCache().lookup(evaluation_cache_key_);
+    if (!cached_output) { return false; }
+
+    ++mcts_search_data_.num_evaluation_cache_hits_;
+    nn_evaluation_batch_id_ = -1;
+    afterNNEvaluation(cached_output);
+    return true;
+}
+
+bool ZeroActor::isSearchSettled() const
+{
+    // a proven root needs no more simulations
+    if (getMCTS()->getRootNode()->isProven()) { return true; }
+
+    // the remaining simulations cannot (or, with a ratio below 1, are unlikely to) let another root child overtake the most visited one
+    if (early_stop_ratio_ <= 0.0f || config::actor_use_gumbel) { return false; }
+    const MCTSNode* root = getMCTS()->getRootNode();
+    float best_count = 0.0f, second_best_count = 0.0f;
+    for (int i = 0; i < root->getNumChildren(); ++i) {
+        float count = root->getChild(i)->getCount();
+        if (count > best_count) {
+            second_best_count = best_count;
+            best_count = count;
+        } else if (count > second_best_count) {
+            second_best_count = count;
+        }
+    }
+    int num_simulation_left = config::actor_num_simulation + 1 - getMCTS()->getNumSimulation();
+    return best_count - second_best_count > num_simulation_left * early_stop_ratio_;
+}
+
 MCTSNode* ZeroActor::decideActionNode()
 {
     if (config::actor_use_gumbel) {
         return gumbel_zero_.decideActionNode(getMCTS());
     } else {
+        if (getMCTS()->getRootNode()->isProven()) {
+            MCTSNode* winning_child = getMCTS()->findProvenWinningChild(getMCTS()->getRootNode());
+            if (winning_child) { return winning_child; }
+        }
         if (config::actor_select_action_by_count) {
             return getMCTS()->selectChildByMaxCount(getMCTS()->getRootNode());
         } else if (config::actor_select_action_by_softmax_count) {
@@ -202,6 +381,7 @@ void ZeroActor::addNoiseToNodeChildren(MCTSNode* node)
             child->setPolicyNoise(dirichlet_noise[i]);
             child->setPolicy((1 - epsilon) * child->getPolicy() + epsilon * dirichlet_noise[i]);
         }
+        getMCTS()->updateChildStatistics(node);
     } else if (config::actor_use_gumbel_noise) {
         std::vector<float> gumbel_noise = utils::Random::randGumbel(node->getNumChildren());
         for (int i = 0; i < node->getNumChildren(); ++i) {
@@ -244,11 +424,297 @@ std::vector<MCTS::ActionCandidate> ZeroActor::calculateMuZeroActionPolicy(MCTSNo
     return action_candidates;
 }
 
-Environment ZeroActor::getEnvironmentTransition(const std::vector<MCTSNode*>& node_path)
+MCTSNode* ZeroActor::findReusableNode()
+{
+    // follow the actions played since the last search from the old root
+    // muzero does not reuse, since the hidden states in the subtree are predicted by the dynamics instead of the representation of the new root
+    if (!config::actor_mcts_reuse_tree || config::actor_use_gumbel || muzero_network_ || !search_) { return nullptr; }
+    const std::vector<Action>& action_history = env_.getActionHistory();
+    if (action_history.size() <= tree_root_num_actions_ || getMCTS()->getNumSimulation() == 0) { return nullptr; }
+
+    auto find_child = [](MCTSNode* node, const Action& action) -> MCTSNode* {
+        for (int i = 0; i < node->getNumChildren(); ++i) {
+            MCTSNode* child = node->getChild(i);
+            if (child->getAction().getActionID() == action.getActionID() && child->getAction().getPlayer() == action.getPlayer()) { return child; }
+        }
+        return nullptr;
+    };
+#if PUZZLE2048 || TETRISBLOCKPUZZLE
+    // with chance nodes, each action leads to an afterstate, whose chance event that actually happened leads to the next state
+    // every played action is followed by one chance event, unless the chance event of the last action is still pending
+    const std::vector<Action>& event_history = env_.getChanceEventHistory();
+    if (config::actor_mcts_chance_node && (env_.getTurn() == env::Player::kPlayerNone || event_history.size() < action_history.size() - tree_root_num_actions_)) { return nullptr; }
+#endif
+
+    MCTSNode* node = getMCTS()->getRootNode();
+    for (size_t i = tree_root_num_actions_; i < action_history.size() && node; ++i) {
+        node = find_child(node, action_history[i]);
+#if PUZZLE2048 || TETRISBLOCKPUZZLE
+        if (config::actor_mcts_chance_node && node) { node = find_child(node, event_history[event_history.size() - (action_history.size() - i)]); }
+#endif
+    }
+
+    // only reuse expanded nodes whose turn matches the environment (e.g., genmove may change the turn)
+    if (!node || node->isLeaf() || node->getCount() == 0 || node->getAction().nextPlayer() != env_.getTurn()) { return nullptr; }
+    return node;
+}
+
+int ZeroActor::acquireHiddenStateSlot()
+{
+    if (!muzero_network_->useHiddenStatePool()) { return -1; }
+    int slot = muzero_network_->acquireHiddenStateSlot();
+    hidden_state_slots_.push_back(slot);
+    return slot;
+}
+
+void ZeroActor::releaseHiddenStateSlots()
 {
-    Environment env = env_;
-    for (size_t i = 1; i < node_path.size(); ++i) { env.act(node_path[i]->getAction()); }
-    return env;
+    // give back the pooled hidden states that are no longer referred by the (reused) tree
+    if (hidden_state_slots_.empty()) { return; }
+    std::unordered_set<int> used_slots;
+    std::vector<const MCTSNode*> nodes{getMCTS()->getRootNode()};
+    while (!nodes.empty()) {
+        const MCTSNode* node = nodes.back();
+        nodes.pop_back();
+        if (node->getHiddenStateDataIndex() != -1) { used_slots.insert(node->getHiddenStateDataIndex()); }
+        for (int i = 0; i < node->getNumChildren(); ++i) { nodes.push_back(node->getChild(i)); }
+    }
+    auto it = std::partition(hidden_state_slots_.begin(), hidden_state_slots_.end(), [&used_slots](int slot) { return used_slots.count(slot) > 0; });
+    for (auto released = it; released != hidden_state_slots_.end(); ++released) { muzero_network_->releaseHiddenStateSlot(*released); }
+    hidden_state_slots_.erase(it, hidden_state_slots_.end());
+}
+
+const Environment& ZeroActor::getEnvironmentTransition(const std::vector<MCTSNode*>& node_path)
+{
+    if (updateEnvironmentTransition(env_transition_, env_transition_path_, node_path)) { ++mcts_search_data_.num_env_transition_copies_; }
+    return env_transition_;
+}
+
+bool ZeroActor::updateEnvironmentTransition(Environment& env_transition, std::vector<MCTSNode*>& env_transition_path, const std::vector<MCTSNode*>& node_path) const
+{
+    // the transition environment is kept for the last path and moved to the new path incrementally,
+    // so it is only copied from the root environment once per search if the environment supports undo
+    // returns whether the root environment is copied
+    size_t num_common_nodes = 0;
+    while (num_common_nodes < env_transition_path.size() && num_common_nodes < node_path.size() && env_transition_path[num_common_nodes] == node_path[num_common_nodes]) { ++num_common_nodes; }
+    bool is_copied = (num_common_nodes == 0 || (num_common_nodes < env_transition_path.size() && !env_transition.supportUndo()));
+    if (is_copied) {
+        env_transition = env_;
+        env_transition_path.assign(1, node_path[0]);
+        num_common_nodes = 1;
+    }
+    for (; env_transition_path.size() > num_common_nodes; env_transition_path.pop_back()) { env_transition.undo(); }
+    for (size_t i = num_common_nodes; i < node_path.size(); ++i) {
+#if PUZZLE2048 || TETRISBLOCKPUZZLE
+        // with chance nodes, actions and the chance events after them are separate nodes
+        if (config::actor_mcts_chance_node) {
+            const Action& action = node_path[i]->getAction();
+            (action.getPlayer() == env::Player::kPlayerNone ? env_transition.actChanceEvent(action) : env_transition.act(action, false));
+        } else {
+            env_transition.act(node_path[i]->getAction());
+        }
+#else
+        env_transition.act(node_path[i]->getAction());
+#endif
+        env_transition_path.push_back(node_path[i]);
+    }
+    return is_copied;
+}
+
+void ZeroActor::selectChanceEvent(std::vector<MCTSNode*>& node_path)
+{
+#if PUZZLE2048 || TETRISBLOCKPUZZLE
+    // an afterstate is expanded with its chance events when a simulation passes it for the first time, with their probabilities as the policy
+    MCTSNode* leaf_node = node_path.back();
+    const Environment& env_transition = getEnvironmentTransition(node_path);
+    if (env_transition.getTurn() != env::Player::kPlayerNone) { return; }
+    std::vector<Action> events = env_transition.getLegalChanceEvents();
+    if (events.empty()) { return; }
+    std::vector<MCTS::ActionCandidate> candidates;
+    for (const auto& event : events) { candidates.emplace_back(event, env_transition.getChanceEventProbability(event), 0.0f); }
+    leaf_node->setReward(env_transition.getReward());
+    getMCTS()->expand(leaf_node, candidates);
+    node_path.push_back(getMCTS()->selectFromNode(leaf_node).back());
+#endif
+}
+
+void ZeroActor::expandAndBackupAlphaZeroLeaf(const std::vector<MCTSNode*>& node_path, const Environment& env_transition, const std::shared_ptr<NetworkOutput>& network_output, utils::Rotation rotation)
+{
+    // the reward of the action before a chance event is kept by the afterstate
+    const float reward = (getMCTS()->isChanceEvent(node_path.back()) ? 0.0f : env_transition.getReward());
+    if (!env_transition.isTerminal()) {
+        std::shared_ptr<AlphaZeroNetworkOutput> alphazero_output = std::static_pointer_cast<AlphaZeroNetworkOutput>(network_output);
+        getMCTS()->expand(node_path.back(), calculateAlphaZeroActionPolicy(env_transition, alphazero_output, rotation));
+        getMCTS()->backup(node_path, alphazero_output->value_, reward);
+    } else {
+        float eval_score = env_transition.getEvalScore();
+        if (config::actor_mcts_solver && env_transition.getNumPlayer() == 2 && eval_score != 0.0f) {
+            // the eval score is from the view of the player not flipping values
+            env::Player value_flipping_player = env::charToPlayer(config::actor_mcts_value_flipping_player);
+            node_path.back()->setProvenWinner(eval_score > 0.0f ? env::getNextPlayer(value_flipping_player, 2) : value_flipping_player);
+        }
+        getMCTS()->backup(node_path, eval_score, reward);
+    }
+}
+
+bool ZeroActor::backupProvenLeaf(const std::vector<MCTSNode*>& node_path)
+{
+    // a proven node is not evaluated again, the value of its proven winner is backed up instead
+    MCTSNode* leaf_node = node_path.back();
+    if (!config::actor_mcts_solver || !leaf_node->isProven()) { return false; }
+    const float value = (leaf_node->getProvenWinner() == env::charToPlayer(config::actor_mcts_value_flipping_player) ? -1.0f : 1.0f);
+    getMCTS()->backup(node_path, value, leaf_node->getReward());
+    return true;
+}
+
+bool ZeroActor::useParallelThink() const
+{
+    // muzero and gumbel search keep the sequential think since their selection or evaluation depends on state outside the tree
+    return config::actor_mcts_think_num_threads > 1 && alphazero_network_ && !config::actor_use_gumbel && !config::actor_mcts_chance_node;
+}
+
+void ZeroActor::parallelThink(const boost::posix_time::ptime& start_ptime)
+{
+    ParallelThinkData& data = parallel_think_data_;
+    data.num_active_workers_ = config::actor_mcts_think_num_threads;
+    data.num_stalled_workers_ = 0;
+    data.num_in_flight_ = 0;
+    data.num_backups_ = 0;
+    data.num_collisions_ = 0;
+    data.start_ptime_ = start_ptime;
+    data.batch_requests_.clear();
+    ++data.num_searches_;
+    prepareInferenceScheduler();
+    utils::ThreadPool thread_pool;
+    thread_pool.start([this](int worker_id, int) { runParallelThinkWorker(worker_id); }, config::actor_mcts_think_num_threads, config::actor_mcts_think_num_threads);
+    mcts_search_data_.num_think_threads_ = config::actor_mcts_think_num_threads;
+    mcts_search_data_.num_batch_collisions_ += data.num_collisions_;
+}
+
+void ZeroActor::runParallelThinkWorker(int worker_id)
+{
+    // each worker selects a leaf under the tree lock, prepares its features on its own transition environment,
+    // waits for the shared batch to be evaluated, and then expands and backs up the leaf under the tree lock again
+    // the seed differs per search and per worker, and from the seeds of the slave threads (program_seed + thread id)
+    ParallelThinkData& data = parallel_think_data_;
+    if (config::program_auto_seed) {
+        utils::Random::seed(std::random_device()());
+    } else {
+        std::seed_seq seed_sequence{static_cast<uint32_t>(config::program_seed), data.num_searches_, static_cast<uint32_t>(worker_id)};
+        utils::Random::seed(seed_sequence);
+    }
+    Environment env_transition;
+    std::vector<MCTSNode*> env_transition_path;
+    std::vector<float> features(alphazero_network_->getInputSize());
+    while (true) {
+        std::vector<MCTSNode*> node_path;
+        {
+            std::unique_lock<std::mutex> lock(data.tree_mutex_);
+            int spent_million_second = (utils::TimeSystem::getLocalTime() - data.start_ptime_).total_milliseconds();
+            if (getMCTS()->getNumSimulation() + data.num_in_flight_ >= config::actor_num_simulation + 1 || isSearchSettled()) { break; }
+            if (config::actor_mcts_think_time_limit > 0 && spent_million_second >= config::actor_mcts_think_time_limit * 1000) { break; }
+            node_path = getMCTS()->select();
+            if (backupProvenLeaf(node_path)) {
+                ++data.num_backups_;
+                data.tree_cv_.notify_all();
+                continue;
+            }
+            getMCTS()->addVirtualLoss(node_path);
+            if (node_path.back()->getVirtualLoss() > 1) {
+                // the leaf is being evaluated by another worker, stall until a backup changes the tree
+                // and let the pending batch be evaluated without this worker meanwhile
+                getMCTS()->removeVirtualLoss(node_path);
+                ++data.num_collisions_;
+                int num_backups = data.num_backups_;
+                setParallelThinkWorkerStalled(true);
+                data.tree_cv_.wait(lock, [&data, num_backups]() { return data.num_backups_ != num_backups; });
+                setParallelThinkWorkerStalled(false);
+                continue;
+            }
+            ++data.num_in_flight_;
+        }
+
+        bool is_env_transition_copied = updateEnvironmentTransition(env_transition, env_transition_path, node_path);
+        utils::Rotation rotation = config::actor_use_random_rotation_features ? static_cast<utils::Rotation>(utils::Random::randInt() % static_cast<int>(utils::Rotation::kRotateSize)) : utils::Rotation::kRotationNone;
+        std::shared_ptr<NetworkOutput> network_output;
+        if (!env_transition.isTerminal()) {
+            env_transition.getFeaturesInto(features.data(), rotation);
+            EvaluationCacheKey evaluation_cache_key{0, 0};
+            if (alphazero_network_->getEvaluationCache().isEnabled()) {
+                evaluation_cache_key = EvaluationCache::hashFeatures(features.data(), features.size());
+                network_output = alphazero_network_->getEvaluationCache().lookup(evaluation_cache_key);
+            }
+            if (!network_output) {
+                network_output = (inference_scheduler_ ? inference_scheduler_->submit(InferenceScheduler::RequestType::kAlphaZero, features).get() : evaluateInParallelThinkBatch(features));
+                if (alphazero_network_->getEvaluationCache().isEnabled()) { alphazero_network_->getEvaluationCache().insert(evaluation_cache_key, network_output->clone()); }
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(data.tree_mutex_);
+        mcts_search_data_.num_env_transition_copies_ += is_env_transition_copied;
+        expandAndBackupAlphaZeroLeaf(node_path, env_transition, network_output, rotation);
+        getMCTS()->removeVirtualLoss(node_path);
+        --data.num_in_flight_;
+        ++data.num_backups_;
+        data.tree_cv_.notify_all();
+    }
+
+    // the remaining workers may be waiting for a batch that can no longer be filled
+    std::lock_guard<std::mutex> lock(data.batch_mutex_);
+    --data.num_active_workers_;
+    data.batch_cv_.notify_all();
+}
+
+void ZeroActor::setParallelThinkWorkerStalled(bool stalled)
+{
+    ParallelThinkData& data = parallel_think_data_;
+    std::lock_guard<std::mutex> lock(data.batch_mutex_);
+    data.num_stalled_workers_ += (stalled ? 1 : -1);
+    data.batch_cv_.notify_all();
+}
+
+std::shared_ptr<NetworkOutput> ZeroActor::evaluateInParallelThinkBatch(const std::vector<float>& features)
+{
+    // the worker filling up the batch runs the network for all workers in it
+    ParallelThinkData& data = parallel_think_data_;
+    std::shared_ptr<NetworkOutput> network_output;
+    std::unique_lock<std::mutex> lock(data.batch_mutex_);
+    std::pair<int, float*> input = alphazero_network_->allocateInput();
+    std::copy(features.begin(), features.end(), input.second);
+    data.batch_requests_.emplace_back(input.first, &network_output);
+    while (!network_output) {
+        if (static_cast<int>(data.batch_requests_.size()) >= std::min(config::actor_mcts_think_batch_size, data.num_active_workers_ - data.num_stalled_workers_)) {
+            std::vector<std::shared_ptr<NetworkOutput>> network_outputs = alphazero_network_->forward();
+            for (auto& request : data.batch_requests_) { *request.second = network_outputs[request.first]; }
+            data.batch_requests_.clear();
+            ++mcts_search_data_.num_batches_;
+            mcts_search_data_.num_batch_leaves_ += network_outputs.size();
+            data.batch_cv_.notify_all();
+        } else {
+            data.batch_cv_.wait(lock);
+        }
+    }
+    return network_output;
+}
+
+void ZeroActor::prepareInferenceScheduler()
+{
+    if (config::actor_mcts_think_batch_deadline_us <= 0) {
+        inference_scheduler_ = nullptr;
+        return;
+    }
+
+    // the scheduler is kept across moves, and recreated when its settings or the model change
+    int max_batch_size = std::min(config::actor_mcts_think_batch_size, alphazero_network_->getMaxBatchSize());
+    if (!inference_scheduler_ || inference_scheduler_->getMaxBatchSize() != max_batch_size || inference_scheduler_->getDeadline() != config::actor_mcts_think_batch_deadline_us
+        || inference_scheduler_->getNumReplicas() != std::max(1, config::actor_mcts_think_num_replicas) || inference_scheduler_replica_file_name_ != alphazero_network_->getNetworkFileName()) {
+        inference_scheduler_ = nullptr; // stop the old replica threads first
+        std::vector<std::shared_ptr<Network>> replicas{alphazero_network_};
+        for (int i = 1; i < config::actor_mcts_think_num_replicas; ++i) { replicas.push_back(createNetwork(alphazero_network_->getNetworkFileName(), alphazero_network_->getGPUID(), max_batch_size, alphazero_network_->getCPUInferenceOptions())); }
+        inference_scheduler_ = std::make_shared<InferenceScheduler>(replicas, max_batch_size, config::actor_mcts_think_batch_deadline_us);
+        inference_scheduler_replica_file_name_ = alphazero_network_->getNetworkFileName();
+    }
+    inference_scheduler_->resetStatistics();
 }
 
 } // namespace minizero::actor
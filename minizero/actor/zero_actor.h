@@ -3,9 +3,14 @@
 #include "alphazero_network.h"
 #include "base_actor.h"
 #include "gumbel_zero.h"
+#include "inference_scheduler.h"
 #include "mcts.h"
 #include "muzero_network.h"
+#include "time_system.h"
+#include <cassert>
+#include <condition_variable>
 #include <memory>
+#include <mutex>
 #include <string>
 #include <unordered_map>
 #include <utility>
@@ -16,15 +21,43 @@ namespace minizero::actor {
 class MCTSSearchData {
 public:
     std::string search_info_;
+    int num_reused_simulation_;
+    int num_evaluation_cache_hits_;
+    int num_batches_;
+    int num_batch_leaves_;
+    int num_batch_collisions_;
+    int num_think_threads_;
+    int num_env_transition_copies_;
     MCTSNode* selected_node_;
     std::vector<MCTSNode*> node_path_;
     void clear();
 };
 
+// the state shared by the worker threads of tree-parallel think
+class ParallelThinkData {
+public:
+    ParallelThinkData() : num_searches_(0) {}
+
+    std::mutex tree_mutex_;
+    std::mutex batch_mutex_;
+    std::condition_variable tree_cv_;
+    std::condition_variable batch_cv_;
+    int num_in_flight_;       // leaves selected but not backed up yet, guarded by tree_mutex_
+    int num_backups_;         // guarded by tree_mutex_
+    int num_collisions_;      // guarded by tree_mutex_
+    int num_active_workers_;  // guarded by batch_mutex_
+    int num_stalled_workers_; // workers waiting for a colliding leaf to be backed up, guarded by batch_mutex_
+    std::vector<std::pair<int, std::shared_ptr<network::NetworkOutput>*>> batch_requests_; // batch index and the output of each waiting worker, guarded by batch_mutex_
+    boost::posix_time::ptime start_ptime_;
+    uint32_t num_searches_; // mixed into the seeds of the workers, whose threads are created for each search
+};
+
 class ZeroActor : public BaseActor {
 public:
     ZeroActor(uint64_t tree_node_size)
-        : tree_node_size_(tree_node_size)
+        : tree_node_size_(tree_node_size),
+          tree_root_num_actions_(0),
+          early_stop_ratio_(0.0f)
     {
         alphazero_network_ = nullptr;
         muzero_network_ = nullptr;
@@ -35,12 +68,21 @@ public:
     Action think(bool with_play = false, bool display_board = false) override;
     void beforeNNEvaluation() override;
     void afterNNEvaluation(const std::shared_ptr<network::NetworkOutput>& network_output) override;
-    bool isSearchDone() const override { return getMCTS()->reachMaximumSimulation(); }
-    Action getSearchAction() const override { return mcts_search_data_.selected_node_->getAction(); }
-    bool isResign() const override { return enable_resign_ && getMCTS()->isResign(mcts_search_data_.selected_node_); }
+    bool isSearchDone() const override { return getMCTS()->reachMaximumSimulation() || isSearchSettled(); }
+    Action getSearchAction() const override
+    {
+        assert(mcts_search_data_.selected_node_); // the action is only decided by handleSearchDone() after the search is reset
+        return mcts_search_data_.selected_node_->getAction();
+    }
+    bool isResign() const override
+    {
+        assert(mcts_search_data_.selected_node_);
+        return enable_resign_ && getMCTS()->isResign(mcts_search_data_.selected_node_);
+    }
     std::string getSearchInfo() const override { return mcts_search_data_.search_info_; }
     void setNetwork(const std::shared_ptr<network::Network>& network) override;
-    std::shared_ptr<Search> createSearch() override { return std::make_shared<MCTS>(tree_node_size_); }
+    std::string getNetworkFileName() const override { return (alphazero_network_ ? alphazero_network_->getNetworkFileName() : (muzero_network_ ? muzero_network_->getNetworkFileName() : BaseActor::getNetworkFileName())); }
+    std::shared_ptr<Search> createSearch() override;
     std::shared_ptr<MCTS> getMCTS() { return std::static_pointer_cast<MCTS>(search_); }
     const std::shared_ptr<MCTS> getMCTS() const { return std::static_pointer_cast<MCTS>(search_); }
 
@@ -51,6 +93,8 @@ protected:
     std::string getEnvReward() const override;
 
     virtual void step();
+    virtual bool selectNNEvaluationLeaf();
+    virtual void allocateNNEvaluationInput();
     virtual void handleSearchDone();
     virtual MCTSNode* decideActionNode();
     virtual void addNoiseToNodeChildren(MCTSNode* node);
@@ -58,15 +102,40 @@ protected:
 
     std::vector<MCTS::ActionCandidate> calculateAlphaZeroActionPolicy(const Environment& env_transition, const std::shared_ptr<network::AlphaZeroNetworkOutput>& alphazero_output, const utils::Rotation& rotation);
     std::vector<MCTS::ActionCandidate> calculateMuZeroActionPolicy(MCTSNode* leaf_node, const std::shared_ptr<network::MuZeroNetworkOutput>& muzero_output);
-    virtual Environment getEnvironmentTransition(const std::vector<MCTSNode*>& node_path);
+    virtual const Environment& getEnvironmentTransition(const std::vector<MCTSNode*>& node_path);
+    virtual void selectChanceEvent(std::vector<MCTSNode*>& node_path);
+    bool updateEnvironmentTransition(Environment& env_transition, std::vector<MCTSNode*>& env_transition_path, const std::vector<MCTSNode*>& node_path) const;
+    void expandAndBackupAlphaZeroLeaf(const std::vector<MCTSNode*>& node_path, const Environment& env_transition, const std::shared_ptr<network::NetworkOutput>& network_output, utils::Rotation rotation);
+    bool backupProvenLeaf(const std::vector<MCTSNode*>& node_path);
+    bool useParallelThink() const;
+    void parallelThink(const boost::posix_time::ptime& start_ptime);
+    void runParallelThinkWorker(int worker_id);
+    void setParallelThinkWorkerStalled(bool stalled);
+    std::shared_ptr<network::NetworkOutput> evaluateInParallelThinkBatch(const std::vector<float>& features);
+    void prepareInferenceScheduler();
+    virtual bool isSearchSettled() const;
+    virtual MCTSNode* findReusableNode();
+    virtual bool evaluateFromCache(const Environment& env_transition);
+    int acquireHiddenStateSlot();
+    void releaseHiddenStateSlots();
 
     bool enable_resign_;
     GumbelZero gumbel_zero_;
     uint64_t tree_node_size_;
+    size_t tree_root_num_actions_;
+    float early_stop_ratio_; // actor_mcts_early_stop_ratio for self-play, actor_mcts_think_early_stop_ratio for think()
     MCTSSearchData mcts_search_data_;
+    Environment env_transition_;
+    std::vector<MCTSNode*> env_transition_path_;
     utils::Rotation feature_rotation_;
+    network::EvaluationCacheKey evaluation_cache_key_;
+    std::vector<float> cache_features_;
+    std::vector<int> hidden_state_slots_; // the slots of the network hidden state pool held by the tree
+    ParallelThinkData parallel_think_data_;
     std::shared_ptr<network::AlphaZeroNetwork> alphazero_network_;
     std::shared_ptr<network::MuZeroNetwork> muzero_network_;
+    std::shared_ptr<network::InferenceScheduler> inference_scheduler_; // batches the evaluations of parallel think by size or deadline, nullptr if not used
+    std::string inference_scheduler_replica_file_name_;                // the model loaded by the replicas of the inference scheduler
 };
 
 } // namespace minizero::actor
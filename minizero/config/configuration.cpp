@@ -14,8 +14,21 @@ float actor_mcts_puct_base = 19652;
 float actor_mcts_puct_init = 1.25;
 float actor_mcts_reward_discount = 1.0f;
 int actor_mcts_think_batch_size = 1;
+int actor_mcts_think_batch_max_collisions = 32;
+int actor_mcts_think_num_threads = 1;
+int actor_mcts_think_batch_deadline_us = 0;
+int actor_mcts_think_num_replicas = 1;
 float actor_mcts_think_time_limit = 0;
+float actor_mcts_think_early_stop_ratio = 0;
+float actor_mcts_early_stop_ratio = 0;
 bool actor_mcts_value_rescale = false;
+bool actor_mcts_reuse_tree = false;
+bool actor_mcts_solver = false;
+bool actor_mcts_chance_node = false;
+bool actor_mcts_simd_selection = false;
+std::string actor_mcts_hidden_state_precision = "fp32";
+bool actor_mcts_device_hidden_state = false;
+int actor_evaluation_cache_memory_mb = 0;
 char actor_mcts_value_flipping_player = 'W';
 bool actor_select_action_by_count = false;
 bool actor_select_action_by_softmax_count = true;
@@ -45,6 +58,10 @@ float zero_disable_resign_ratio = 0.1;
 int zero_actor_intermediate_sequence_length = 0;
 std::string zero_actor_ignored_command = "reset_actors";
 bool zero_server_accept_different_model_games = true;
+int zero_actor_num_pipeline_cohorts = 1;
+int zero_actor_pipeline_report_interval = 60;
+int zero_actor_num_cpu_networks = 1;
+bool zero_actor_pin_cpu_networks = false;
 
 // learner parameters
 bool learner_use_per = false;
@@ -62,6 +79,8 @@ float learner_momentum = 0.9;
 float learner_weight_decay = 0.0001;
 float learner_value_loss_scale = 1.0f;
 int learner_num_thread = 8;
+int learner_env_checkpoint_interval = 16;
+int learner_env_checkpoint_cache_memory_mb = 1024;
 
 // network parameters
 std::string nn_file_name = "";
@@ -69,6 +88,15 @@ int nn_num_blocks = 1;
 int nn_num_hidden_channels = 256;
 int nn_num_value_hidden_channels = 256;
 std::string nn_type_name = "alphazero";
+bool nn_cpu_optimize_for_inference = false;
+bool nn_cpu_quantize_int8 = false;
+int nn_cpu_num_intra_op_threads = 0;
+int nn_cpu_num_inter_op_threads = 0;
+std::string nn_server_name = "";
+int nn_server_num_slots = 16;
+int nn_server_max_batch_size_per_slot = 256;
+int nn_server_max_batch_size = 1024;
+int nn_server_batch_deadline_us = 1000;
 
 // environment parameters
 int env_board_size = 0;
@@ -100,8 +128,21 @@ void setConfiguration(ConfigureLoader& cl)
     cl.addParameter("actor_mcts_puct_init", actor_mcts_puct_init, "hyperparameter for puct_bias in the PUCT formula of MCTS", "Actor");                                       // ref: AZ, Sec. Methods
     cl.addParameter("actor_mcts_reward_discount", actor_mcts_reward_discount, "discount factor for calculating Q values", "Actor");                                           // ref: MZ, Sec. Methods
     cl.addParameter("actor_mcts_value_rescale", actor_mcts_value_rescale, "true for games whose rewards are not bounded in [-1, 1], e.g., Atari games", "Actor");             // ref: MZ
+    cl.addParameter("actor_mcts_reuse_tree", actor_mcts_reuse_tree, "true for reusing the subtree of the played action (and its chance event with actor_mcts_chance_node) as the search tree of the next move; not supported with actor_use_gumbel or muzero", "Actor");
+    cl.addParameter("actor_mcts_solver", actor_mcts_solver, "true for proving wins and losses from terminal positions in the search tree, so that solved subtrees are not searched again and the search stops once the root is proven; only for two-player games with alphazero; not supported with actor_use_gumbel", "Actor");
+    cl.addParameter("actor_mcts_chance_node", actor_mcts_chance_node, "true for searching stochastic games (e.g., puzzle2048) with explicit chance nodes after actions, whose chance events are added at the first visit and backed up by their expected value; only supports alphazero; not supported with actor_mcts_think_num_threads > 1", "Actor");
+    cl.addParameter("actor_mcts_simd_selection", actor_mcts_simd_selection, "true for keeping the statistics of sibling nodes in contiguous arrays and selecting children by a SIMD PUCT kernel", "Actor");
+    cl.addParameter("actor_mcts_hidden_state_precision", actor_mcts_hidden_state_precision, "the storage precision of hidden states in the search tree: fp32, fp16, or bf16; only supports muzero", "Actor");
+    cl.addParameter("actor_mcts_device_hidden_state", actor_mcts_device_hidden_state, "true for keeping hidden states in a tensor pool on the network device and gathering recurrent inputs there, instead of copying them to and from the host; only supports muzero", "Actor");
+    cl.addParameter("actor_evaluation_cache_memory_mb", actor_evaluation_cache_memory_mb, "the memory budget in MB of the network evaluation cache shared by actors on the same network; 0 to disable; only supports alphazero", "Actor");
     cl.addParameter("actor_mcts_think_batch_size", actor_mcts_think_batch_size, "the MCTS selection batch size; only works when running console", "Actor");
+    cl.addParameter("actor_mcts_think_batch_max_collisions", actor_mcts_think_batch_max_collisions, "the maximum number of selections reaching leaves already in the batch before evaluating a smaller batch; only works when running console", "Actor");
+    cl.addParameter("actor_mcts_think_num_threads", actor_mcts_think_num_threads, "the number of threads searching the same tree in parallel, the batch size is at most actor_mcts_think_batch_size; the search is not deterministic with more than one thread; only works when running console with alphazero", "Actor");
+    cl.addParameter("actor_mcts_think_batch_deadline_us", actor_mcts_think_batch_deadline_us, "the deadline in microseconds for the inference scheduler to run a partial batch of the parallel think threads, which batches their requests by size or deadline; 0 to batch them by the number of waiting threads instead", "Actor");
+    cl.addParameter("actor_mcts_think_num_replicas", actor_mcts_think_num_replicas, "the number of network replicas on the same device run by the inference scheduler, so that batches overlap; only works with actor_mcts_think_batch_deadline_us > 0", "Actor");
     cl.addParameter("actor_mcts_think_time_limit", actor_mcts_think_time_limit, "the MCTS time limit in seconds, 0 represents disabling time limit (only uses actor_num_simulation); only works when running console", "Actor");
+    cl.addParameter("actor_mcts_think_early_stop_ratio", actor_mcts_think_early_stop_ratio, "the same as actor_mcts_early_stop_ratio, but only works when running console", "Actor");
+    cl.addParameter("actor_mcts_early_stop_ratio", actor_mcts_early_stop_ratio, "stop the search once the visit lead of the most visited root child exceeds the remaining simulations times this ratio; 0 to disable, 1 to stop only when the lead cannot be overtaken, and smaller values to stop when it is unlikely to be; not supported with actor_use_gumbel", "Actor");
     cl.addParameter("actor_select_action_by_count", actor_select_action_by_count, "true for selecting the action by the maximum MCTS count; should not be true together with actor_select_action_by_softmax_count", "Actor");
     cl.addParameter("actor_select_action_by_softmax_count", actor_select_action_by_softmax_count, "true for selecting the action by the propotion of MCTS count; should not be true together with actor_select_action_by_count", "Actor");
     cl.addParameter("actor_select_action_softmax_temperature", actor_select_action_softmax_temperature, "the softmax temperature when using actor_select_action_by_softmax_count", "Actor");
@@ -130,6 +171,10 @@ void setConfiguration(ConfigureLoader& cl)
     cl.addParameter("zero_actor_intermediate_sequence_length", zero_actor_intermediate_sequence_length, "the max sequence length when running self-play; usually 0 (unlimited) for board games, 200 for atari games", "Zero"); // ref: MZ
     cl.addParameter("zero_actor_ignored_command", zero_actor_ignored_command, "the commands to ignore by the actor; format: command1 command2 ...", "Zero");
     cl.addParameter("zero_server_accept_different_model_games", zero_server_accept_different_model_games, "true for accepting self-play games generated by out-of-date model", "Zero");
+    cl.addParameter("zero_actor_num_pipeline_cohorts", zero_actor_num_pipeline_cohorts, "the number of actor cohorts; 1 alternates CPU and GPU phases, larger values run one cohort's inference while another cohort does search", "Zero");
+    cl.addParameter("zero_actor_pipeline_report_interval", zero_actor_pipeline_report_interval, "the interval in seconds to report CPU/GPU utilization and tree memory of the actor pipeline; 0 to disable", "Zero");
+    cl.addParameter("zero_actor_num_cpu_networks", zero_actor_num_cpu_networks, "the number of network instances per cohort when no GPU is available; each runs inference on its own thread", "Zero");
+    cl.addParameter("zero_actor_pin_cpu_networks", zero_actor_pin_cpu_networks, "true for pinning the inference thread of each CPU network to its own subset of cores", "Zero");
 
     // learner parameters
     cl.addParameter("learner_use_per", learner_use_per, "true for enabling Prioritized Experience Replay", "Learner");                                                              // ref: PER
@@ -147,6 +192,8 @@ void setConfiguration(ConfigureLoader& cl)
     cl.addParameter("learner_weight_decay", learner_weight_decay, "hyperparameter for weight decay; usually 0.0001 for sgd, 0 for adam, 0.01 for adamw", "Learner");
     cl.addParameter("learner_value_loss_scale", learner_value_loss_scale, "hyperparameter for scaling of the value loss", "Learner");
     cl.addParameter("learner_num_thread", learner_num_thread, "the number of threads for training", "Learner");
+    cl.addParameter("learner_env_checkpoint_interval", learner_env_checkpoint_interval, "the number of actions between two environment checkpoints when replaying game records for training features, 0 represents disabling checkpoints", "Learner");
+    cl.addParameter("learner_env_checkpoint_cache_memory_mb", learner_env_checkpoint_cache_memory_mb, "the memory budget in MB of the environment checkpoints cached over all game records in the replay buffer, the checkpoints of the records least recently replayed are evicted first", "Learner");
 
     // network parameters
     cl.addParameter("nn_file_name", nn_file_name, "the file name of model weights", "Network");
@@ -154,6 +201,15 @@ void setConfiguration(ConfigureLoader& cl)
     cl.addParameter("nn_num_hidden_channels", nn_num_hidden_channels, "hyperparameter for the model; the size of the hidden channels in residual blocks", "Network");               // ref: AGZ
     cl.addParameter("nn_num_value_hidden_channels", nn_num_value_hidden_channels, "hyperparameter for the model; the size of the hidden channels in the value network", "Network"); // ref: AGZ
     cl.addParameter("nn_type_name", nn_type_name, "the type of training algorithm and network: alphazero/muzero", "Network");
+    cl.addParameter("nn_cpu_optimize_for_inference", nn_cpu_optimize_for_inference, "true for freezing the model and fusing its operators when running on CPU", "Network");
+    cl.addParameter("nn_cpu_quantize_int8", nn_cpu_quantize_int8, "true for exporting models with int8 dynamically quantized linear layers in the learner, and loading them when running on CPU", "Network");
+    cl.addParameter("nn_cpu_num_intra_op_threads", nn_cpu_num_intra_op_threads, "the number of threads used by one forward on CPU; 0 for zero_num_threads divided by the number of CPU networks", "Network");
+    cl.addParameter("nn_cpu_num_inter_op_threads", nn_cpu_num_inter_op_threads, "the number of inter-op threads of libtorch on CPU; 0 for the libtorch default", "Network");
+    cl.addParameter("nn_server_name", nn_server_name, "the shared memory name of the nn_server on the same machine; empty for loading the networks in each self-play process, otherwise self-play sends its batches to the nn_server (-mode nn_server) of this name; only supports alphazero", "Network");
+    cl.addParameter("nn_server_num_slots", nn_server_num_slots, "the number of request slots of the nn_server, each network of a connected self-play process holds one slot", "Network");
+    cl.addParameter("nn_server_max_batch_size_per_slot", nn_server_max_batch_size_per_slot, "the maximum batch size of one request slot of the nn_server", "Network");
+    cl.addParameter("nn_server_max_batch_size", nn_server_max_batch_size, "the maximum batch size of one forward in the nn_server, which gathers the requests of several slots", "Network");
+    cl.addParameter("nn_server_batch_deadline_us", nn_server_batch_deadline_us, "the time in microseconds for the nn_server to wait for the requests of the other connected slots before running a partial batch", "Network");
 
     // environment parameters
     cl.addParameter("env_board_size", env_board_size, "the size of board", "Environment");
@@ -16,8 +16,21 @@ extern float actor_mcts_puct_base;
 extern float actor_mcts_puct_init;
 extern float actor_mcts_reward_discount;
 extern int actor_mcts_think_batch_size;
+extern int actor_mcts_think_batch_max_collisions;
+extern int actor_mcts_think_num_threads;
+extern int actor_mcts_think_batch_deadline_us;
+extern int actor_mcts_think_num_replicas;
 extern float actor_mcts_think_time_limit;
+extern float actor_mcts_think_early_stop_ratio;
+extern float actor_mcts_early_stop_ratio;
 extern bool actor_mcts_value_rescale;
+extern bool actor_mcts_reuse_tree;
+extern bool actor_mcts_solver;
+extern bool actor_mcts_chance_node;
+extern bool actor_mcts_simd_selection;
+extern std::string actor_mcts_hidden_state_precision;
+extern bool actor_mcts_device_hidden_state;
+extern int actor_evaluation_cache_memory_mb;
 extern char actor_mcts_value_flipping_player;
 extern bool actor_select_action_by_count;
 extern bool actor_select_action_by_softmax_count;
@@ -47,6 +60,10 @@ extern float zero_disable_resign_ratio;
 extern int zero_actor_intermediate_sequence_length;
 extern std::string zero_actor_ignored_command;
 extern bool zero_server_accept_different_model_games;
+extern int zero_actor_num_pipeline_cohorts;
+extern int zero_actor_pipeline_report_interval;
+extern int zero_actor_num_cpu_networks;
+extern bool zero_actor_pin_cpu_networks;
 
 // learner parameters
 extern bool learner_use_per;
@@ -64,6 +81,8 @@ extern float learner_momentum;
 extern float learner_weight_decay;
 extern float learner_value_loss_scale;
 extern int learner_num_thread;
+extern int learner_env_checkpoint_interval;
+extern int learner_env_checkpoint_cache_memory_mb;
 
 // network parameters
 extern std::string nn_file_name;
@@ -71,6 +90,15 @@ extern int nn_num_blocks;
 extern int nn_num_hidden_channels;
 extern int nn_num_value_hidden_channels;
 extern std::string nn_type_name;
+extern bool nn_cpu_optimize_for_inference;
+extern bool nn_cpu_quantize_int8;
+extern int nn_cpu_num_intra_op_threads;
+extern int nn_cpu_num_inter_op_threads;
+extern std::string nn_server_name;
+extern int nn_server_num_slots;
+extern int nn_server_max_batch_size_per_slot;
+extern int nn_server_max_batch_size;
+extern int nn_server_batch_deadline_us;
 
 // environment parameters
 extern int env_board_size;
@@ -9,6 +9,7 @@
 #include <iomanip>
 #include <iostream>
 #include <sstream>
+#include <torch/cuda.h>
 #include <utility>
 
 namespace minizero::console {
@@ -40,7 +41,8 @@ Console::Console()
 
 void Console::initialize()
 {
-    if (!network_) { network_ = createNetwork(config::nn_file_name, 0); }
+    // run on CPU if there is no GPU
+    if (!network_) { network_ = createNetwork(config::nn_file_name, (torch::cuda::device_count() > 0 ? 0 : -1), config::actor_mcts_think_batch_size, actor::createCPUInferenceOptions(1)); }
     if (!actor_) {
         uint64_t tree_node_size = static_cast<uint64_t>(config::actor_num_simulation + 1) * network_->getActionSize();
         actor_ = actor::createActor(tree_node_size, network_);
@@ -52,13 +54,13 @@ void Console::initialize()
     if (network_->getNetworkTypeName() == "alphazero") {
         std::shared_ptr<network::AlphaZeroNetwork> alphazero_network = std::static_pointer_cast<network::AlphaZeroNetwork>(network_);
         for (int i = 0; i < num_warmup_forward; ++i) {
-            for (int j = 0; j < config::actor_mcts_think_batch_size; ++j) { alphazero_network->pushBack(actor_->getEnvironment().getFeatures()); }
+            for (int j = 0; j < config::actor_mcts_think_batch_size; ++j) { actor_->getEnvironment().getFeaturesInto(alphazero_network->allocateInput().second); }
             alphazero_network->forward();
         }
     } else if (network_->getNetworkTypeName() == "muzero" || network_->getNetworkTypeName() == "muzero_atari") {
         std::shared_ptr<network::MuZeroNetwork> muzero_network = std::static_pointer_cast<network::MuZeroNetwork>(network_);
         for (int i = 0; i < num_warmup_forward; ++i) {
-            for (int j = 0; j < config::actor_mcts_think_batch_size; ++j) { muzero_network->pushBackInitialData(actor_->getEnvironment().getFeatures()); }
+            for (int j = 0; j < config::actor_mcts_think_batch_size; ++j) { actor_->getEnvironment().getFeaturesInto(muzero_network->allocateInitialInput().second); }
             muzero_network->initialInference();
         }
     } else {
@@ -269,8 +271,9 @@ void Console::calculatePolicyValue(std::vector<float>& policy, float& value, uti
 {
     if (network_->getNetworkTypeName() == "alphazero") {
         std::shared_ptr<network::AlphaZeroNetwork> alphazero_network = std::static_pointer_cast<network::AlphaZeroNetwork>(network_);
-        int index = alphazero_network->pushBack(actor_->getEnvironment().getFeatures(rotation));
-        std::shared_ptr<NetworkOutput> network_output = alphazero_network->forward()[index];
+        std::pair<int, float*> input = alphazero_network->allocateInput();
+        actor_->getEnvironment().getFeaturesInto(input.second, rotation);
+        std::shared_ptr<NetworkOutput> network_output = alphazero_network->forward()[input.first];
         std::shared_ptr<minizero::network::AlphaZeroNetworkOutput> zero_output = std::static_pointer_cast<minizero::network::AlphaZeroNetworkOutput>(network_output);
         value = zero_output->value_;
         policy.clear();
@@ -280,10 +283,11 @@ void Console::calculatePolicyValue(std::vector<float>& policy, float& value, uti
         }
     } else if (network_->getNetworkTypeName() == "muzero" || network_->getNetworkTypeName() == "muzero_atari") {
         std::shared_ptr<network::MuZeroNetwork> muzero_network = std::static_pointer_cast<network::MuZeroNetwork>(network_);
-        int index = muzero_network->pushBackInitialData(actor_->getEnvironment().getFeatures());
-        std::shared_ptr<NetworkOutput> network_output = muzero_network->initialInference()[index];
+        std::pair<int, float*> input = muzero_network->allocateInitialInput();
+        actor_->getEnvironment().getFeaturesInto(input.second);
+        std::shared_ptr<NetworkOutput> network_output = muzero_network->initialInference()[input.first];
         std::shared_ptr<minizero::network::MuZeroNetworkOutput> zero_output = std::static_pointer_cast<minizero::network::MuZeroNetworkOutput>(network_output);
-        policy = zero_output->policy_;
+        policy.assign(zero_output->policy_.begin(), zero_output->policy_.end());
         value = zero_output->value_;
     } else {
         assert(false); // should not be here
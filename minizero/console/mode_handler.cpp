@@ -1,13 +1,23 @@
 #include "mode_handler.h"
 #include "actor_group.h"
 #include "console.h"
+#include "create_actor.h"
+#include "create_network.h"
+#include "data_loader.h"
 #include "git_info.h"
+#include "mcts.h"
+#include "nn_server.h"
 #include "obs_recover.h"
 #include "obs_remover.h"
 #include "ostream_redirector.h"
 #include "random.h"
+#include "time_system.h"
+#include "utils.h"
 #include "zero_server.h"
+#include <algorithm>
+#include <numeric>
 #include <string>
+#include <torch/cuda.h>
 #include <vector>
 
 namespace minizero::console {
@@ -23,6 +33,11 @@ ModeHandler::ModeHandler()
     RegisterFunction("env_test", this, &ModeHandler::runEnvTest);
     RegisterFunction("remove_obs", this, &ModeHandler::runRemoveObs);
     RegisterFunction("recover_obs", this, &ModeHandler::runRecoverObs);
+    RegisterFunction("replay_buffer_benchmark", this, &ModeHandler::runReplayBufferBenchmark);
+    RegisterFunction("mcts_selection_benchmark", this, &ModeHandler::runMCTSSelectionBenchmark);
+    RegisterFunction("chance_node_benchmark", this, &ModeHandler::runChanceNodeBenchmark);
+    RegisterFunction("cpu_inference_benchmark", this, &ModeHandler::runCPUInferenceBenchmark);
+    RegisterFunction("nn_server", this, &ModeHandler::runNNServer);
 }
 
 void ModeHandler::run(int argc, char* argv[])
@@ -202,4 +217,213 @@ void ModeHandler::runRecoverObs()
 #endif
 }
 
+void ModeHandler::runReplayBufferBenchmark()
+{
+    // generate one random game and fill the replay buffer with its copies
+    Environment env;
+    env.reset();
+    while (!env.isTerminal()) {
+        std::vector<Action> legal_actions = env.getLegalActions();
+        env.act(legal_actions[utils::Random::randInt() % legal_actions.size()]);
+    }
+    EnvironmentLoader env_loader;
+    env_loader.loadFromEnvironment(env);
+
+    const int num_samples = 1000000;
+    std::cout << "game length: " << env.getActionHistory().size() << std::endl;
+    for (int num_games : {1000, 10000, 100000}) {
+        config::zero_replay_buffer = 1;
+        config::zero_num_games_per_iteration = num_games;
+        learner::ReplayBuffer replay_buffer;
+        for (int i = 0; i < num_games; ++i) { replay_buffer.addData(env_loader); }
+
+        boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
+        for (int i = 0; i < num_samples; ++i) { replay_buffer.sampleEnvAndPos(); }
+        float sample_seconds = (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1000000.0f;
+
+        start_ptime = utils::TimeSystem::getLocalTime();
+        for (int i = 0; i < num_samples; ++i) {
+            std::pair<int, int> p = replay_buffer.sampleEnvAndPos();
+            replay_buffer.updatePositionPriority(p.first, p.second, utils::Random::randReal());
+            replay_buffer.updateGamePriority(p.first);
+        }
+        float update_seconds = (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1000000.0f - sample_seconds;
+
+        std::cout << "buffer size: " << num_games << " games (" << replay_buffer.num_data_ << " positions)"
+                  << ", sample: " << num_samples / sample_seconds << " samples/s"
+                  << ", update: " << num_samples / std::max(update_seconds, 1e-6f) << " updates/s" << std::endl;
+    }
+}
+
+template <class Node>
+std::vector<int> benchmarkMCTSSelection(const std::string& name, int num_selections, const std::vector<typename actor::BasicMCTS<Node>::ActionCandidate>& candidates, const std::vector<std::pair<int, float>>& visits)
+{
+    actor::BasicMCTS<Node> mcts(candidates.size());
+    mcts.reset();
+    mcts.expand(mcts.getRootNode(), candidates);
+    mcts.backup({mcts.getRootNode()}, 0.0f);
+    for (const auto& visit : visits) { mcts.backup({mcts.getRootNode(), mcts.getRootNode()->getChild(visit.first)}, visit.second); }
+
+    // alternate virtual losses on the selected child so that consecutive selections differ
+    std::vector<int> selected_ids;
+    selected_ids.reserve(num_selections);
+    boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
+    for (int i = 0; i < num_selections; ++i) {
+        std::vector<Node*> node_path = mcts.select();
+        selected_ids.push_back(node_path.back()->getAction().getActionID());
+        if (i % 2 == 0) {
+            mcts.addVirtualLoss(node_path);
+        } else {
+            mcts.removeVirtualLoss(node_path, node_path.back()->getVirtualLoss());
+        }
+    }
+    float seconds = (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1000000.0f;
+    std::cout << name << " (" << sizeof(Node) << " bytes/node), "
+              << (mcts.useChildStatistics() ? std::string("simd (") + actor::getPUCTKernelName() + ")" : std::string("node")) << " selection: "
+              << num_selections / seconds << " selections/s" << std::endl;
+    return selected_ids;
+}
+
+void ModeHandler::runMCTSSelectionBenchmark()
+{
+    // build a root with 362 children (19x19 go) and a few thousand visits, then repeatedly select from it
+    const int num_children = 362;
+    const int num_visits = 4000;
+    const int num_selections = 1000000;
+    std::vector<float> policy(num_children);
+    for (auto& p : policy) { p = utils::Random::randReal(); }
+    float policy_sum = std::accumulate(policy.begin(), policy.end(), 0.0f);
+    std::vector<actor::BasicMCTS<actor::FullMCTSNode>::ActionCandidate> full_candidates;
+    std::vector<actor::BasicMCTS<actor::CompactMCTSNode>::ActionCandidate> compact_candidates;
+    for (int i = 0; i < num_children; ++i) {
+        full_candidates.emplace_back(Action(i, env::Player::kPlayer1), policy[i] / policy_sum, 0.0f);
+        compact_candidates.emplace_back(Action(i, env::Player::kPlayer1), policy[i] / policy_sum, 0.0f);
+    }
+    std::vector<std::pair<int, float>> visits; // child index, value
+    for (int i = 0; i < num_visits; ++i) { visits.emplace_back(utils::Random::randInt() % 64, utils::Random::randReal(2) - 1); }
+
+    // compare every combination of node layout and selection against the full node layout with node selection
+    std::vector<std::vector<int>> selected_ids;
+    for (bool simd_selection : {false, true}) {
+        config::actor_mcts_simd_selection = simd_selection;
+        selected_ids.push_back(benchmarkMCTSSelection<actor::FullMCTSNode>("full node", num_selections, full_candidates, visits));
+        selected_ids.push_back(benchmarkMCTSSelection<actor::CompactMCTSNode>("compact node", num_selections, compact_candidates, visits));
+    }
+
+    for (size_t i = 1; i < selected_ids.size(); ++i) {
+        int num_same = 0;
+        for (int j = 0; j < num_selections; ++j) { num_same += (selected_ids[0][j] == selected_ids[i][j]); }
+        std::cout << "identical selections (run " << i << "): " << num_same << " / " << num_selections << std::endl;
+    }
+}
+
+void ModeHandler::runChanceNodeBenchmark()
+{
+#if PUZZLE2048
+    // play the same seeds greedily with and without chance nodes at several simulation counts, and compare the average scores
+    const int num_games = 10;
+    const int max_num_simulation = config::actor_num_simulation;
+    const bool chance_node = config::actor_mcts_chance_node;
+    config::actor_select_action_by_count = true;
+    config::actor_select_action_by_softmax_count = false;
+    config::actor_use_dirichlet_noise = false;
+    std::shared_ptr<network::Network> network = network::createNetwork(config::nn_file_name, 0, config::actor_mcts_think_batch_size);
+    for (int num_simulation : {max_num_simulation / 4, max_num_simulation / 2, max_num_simulation}) {
+        if (num_simulation <= 0) { continue; }
+        for (bool use_chance_node : {false, true}) {
+            config::actor_num_simulation = num_simulation;
+            config::actor_mcts_chance_node = use_chance_node;
+            std::shared_ptr<actor::BaseActor> actor = actor::createActor(static_cast<uint64_t>(num_simulation + 1) * network->getActionSize(), network);
+            float sum_of_score = 0.0f;
+            int num_moves = 0;
+            boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
+            for (int i = 0; i < num_games; ++i) {
+                actor->reset();
+                actor->getEnvironment().reset(config::program_seed + i);
+                while (!actor->isEnvTerminal()) { actor->think(true); }
+                sum_of_score += actor->getEvalScore();
+                num_moves += actor->getEnvironment().getActionHistory().size();
+            }
+            float seconds = (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1000000.0f;
+            std::cout << "simulation: " << num_simulation
+                      << ", chance node: " << (use_chance_node ? "on" : "off")
+                      << ", average score: " << sum_of_score / num_games
+                      << ", average moves: " << static_cast<float>(num_moves) / num_games
+                      << ", moves/s: " << num_moves / std::max(seconds, 1e-6f) << std::endl;
+        }
+    }
+    config::actor_num_simulation = max_num_simulation;
+    config::actor_mcts_chance_node = chance_node;
+#else
+    std::cout << "Currently, only support chance node benchmark for puzzle2048" << std::endl;
+#endif
+}
+
+void ModeHandler::runCPUInferenceBenchmark()
+{
+    // run each model (nn_file_name, separated by ':') on CPU at several batch sizes, with and without the inference optimization
+    const float seconds_per_run = 3.0f;
+    network::CPUInferenceOptions cpu_inference_options = actor::createCPUInferenceOptions(1);
+    if (config::nn_cpu_num_inter_op_threads > 0) { torch::set_num_interop_threads(config::nn_cpu_num_inter_op_threads); }
+    for (const std::string& nn_file_name : utils::stringToVector(config::nn_file_name, ":")) {
+        for (bool optimize_for_inference : {false, true}) {
+            cpu_inference_options.optimize_for_inference_ = optimize_for_inference;
+            for (int batch_size : {1, 16, 64}) {
+                std::shared_ptr<network::Network> network = network::createNetwork(nn_file_name, -1, batch_size, cpu_inference_options);
+                std::shared_ptr<network::AlphaZeroNetwork> alphazero_network = std::dynamic_pointer_cast<network::AlphaZeroNetwork>(network);
+                std::shared_ptr<network::MuZeroNetwork> muzero_network = std::dynamic_pointer_cast<network::MuZeroNetwork>(network);
+                auto forward = [&]() {
+                    for (int i = 0; i < batch_size; ++i) {
+                        float* input = (alphazero_network ? alphazero_network->allocateInput().second : muzero_network->allocateInitialInput().second);
+                        std::fill(input, input + network->getNumInputChannels() * network->getInputChannelHeight() * network->getInputChannelWidth(), 0.0f);
+                    }
+                    if (alphazero_network) {
+                        alphazero_network->forward();
+                    } else {
+                        muzero_network->initialInference();
+                    }
+                };
+
+                // the first forwards are slower since the graph executor profiles and optimizes the graph
+                for (int i = 0; i < 3; ++i) { forward(); }
+                int num_positions = 0;
+                float seconds = 0.0f;
+                boost::posix_time::ptime start_ptime = utils::TimeSystem::getLocalTime();
+                while (seconds < seconds_per_run) {
+                    forward();
+                    num_positions += batch_size;
+                    seconds = (utils::TimeSystem::getLocalTime() - start_ptime).total_microseconds() / 1000000.0f;
+                }
+                std::cout << nn_file_name << " (" << network->getNumBlocks() << " blocks, " << network->getNumHiddenChannels() << " channels)"
+                          << ", optimize for inference: " << (optimize_for_inference ? "on" : "off")
+                          << ", int8: " << (cpu_inference_options.quantize_int8_ ? "on" : "off")
+                          << ", batch size: " << batch_size
+                          << ", threads: " << cpu_inference_options.num_intra_op_threads_
+                          << ", positions/s: " << num_positions / seconds
+                          << ", positions/s per core: " << num_positions / seconds / cpu_inference_options.num_intra_op_threads_ << std::endl;
+            }
+        }
+    }
+}
+
+void ModeHandler::runNNServer()
+{
+    // load one network per GPU (or zero_actor_num_cpu_networks on CPU) and serve the self-play processes started with the same nn_server_name
+    if (config::nn_server_name.empty()) {
+        std::cerr << "nn_server_name is not set" << std::endl;
+        exit(-1);
+    }
+    const int report_interval = 60;
+    bool use_gpu = (torch::cuda::device_count() > 0);
+    int num_networks = (use_gpu ? static_cast<int>(torch::cuda::device_count()) : config::zero_actor_num_cpu_networks);
+    network::CPUInferenceOptions cpu_inference_options = actor::createCPUInferenceOptions(num_networks);
+    if (!use_gpu && config::nn_cpu_num_inter_op_threads > 0) { torch::set_num_interop_threads(config::nn_cpu_num_inter_op_threads); }
+    std::vector<std::shared_ptr<network::Network>> networks;
+    for (int id = 0; id < num_networks; ++id) { networks.push_back(network::createNetwork(config::nn_file_name, (use_gpu ? id : -1), config::nn_server_max_batch_size, cpu_inference_options)); }
+    std::cerr << networks[0]->toString();
+
+    network::NNServer nn_server(config::nn_server_name, networks, config::nn_server_num_slots, config::nn_server_max_batch_size_per_slot, config::nn_server_batch_deadline_us);
+    nn_server.run(report_interval);
+}
+
 } // namespace minizero::console
@@ -49,6 +49,11 @@ protected:
     virtual void runEnvTest();
     virtual void runRemoveObs();
     virtual void runRecoverObs();
+    virtual void runReplayBufferBenchmark();
+    virtual void runMCTSSelectionBenchmark();
+    virtual void runChanceNodeBenchmark();
+    virtual void runCPUInferenceBenchmark();
+    virtual void runNNServer();
 
     std::map<std::string, std::shared_ptr<BaseFunction>> function_map_;
 };
@@ -220,6 +220,13 @@ std::vector<float> AtariEnvLoader::getFeatures(const int pos, utils::Rotation ro
     return features;
 }
 
+void AtariEnvLoader::getFeaturesInto(const int pos, float* features, utils::Rotation rotation /* = utils::Rotation::kRotationNone */) const
+{
+    // observations are stored in the record, replaying the environment is only a fallback
+    std::vector<float> loader_features = getFeatures(pos, rotation);
+    std::copy(loader_features.begin(), loader_features.end(), features);
+}
+
 std::vector<float> AtariEnvLoader::getActionFeatures(const int pos, utils::Rotation rotation /* = utils::Rotation::kRotationNone */) const
 {
     int hidden_size = kAtariHiddenChannelHeight * kAtariHiddenChannelWidth;
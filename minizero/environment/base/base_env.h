@@ -6,9 +6,12 @@
 #include "utils.h"
 #include "vector_map.h"
 #include <algorithm>
+#include <atomic>
 #include <cassert>
 #include <fstream>
+#include <list>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
 #include <utility>
@@ -84,7 +87,6 @@ public:
     virtual bool isTerminal() const = 0;
     virtual float getReward() const = 0;
     virtual float getEvalScore(bool is_resign = false) const = 0;
-    virtual std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const = 0;
     virtual std::vector<float> getActionFeatures(const Action& action, utils::Rotation rotation = utils::Rotation::kRotationNone) const = 0;
     virtual int getNumInputChannels() const = 0;
     virtual int getNumActionFeatureChannels() const = 0;
@@ -101,16 +103,155 @@ public:
     virtual int getNumPlayer() const = 0;
     virtual void setTurn(Player p) { turn_ = p; }
 
+    // the memory held by the environment outside of the object itself, for estimating the memory of environment snapshots
+    virtual size_t getHeapMemorySize() const
+    {
+        size_t size = actions_.capacity() * sizeof(Action) + observations_.capacity() * sizeof(std::string);
+        for (const auto& observation : observations_) { size += observation.capacity(); }
+        return size;
+    }
+
+    // environments supporting undo let actors walk one scratch environment through the search tree instead of copying it
+    virtual bool supportUndo() const { return false; }
+    virtual void undo() { assert(false); }
+
+    // getFeaturesInto writes getNumInputChannels() * getInputChannelHeight() * getInputChannelWidth() floats into features without allocation
+    // by default it copies getFeatures, environments overriding it can implement getFeatures by getFeaturesIntoVector
+    virtual std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const = 0;
+    virtual void getFeaturesInto(float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const
+    {
+        std::vector<float> env_features = getFeatures(rotation);
+        std::copy(env_features.begin(), env_features.end(), features);
+    }
+
     inline Player getTurn() const { return turn_; }
     inline const std::vector<Action>& getActionHistory() const { return actions_; }
     inline const std::vector<std::string>& getObservationHistory() const { return observations_; }
 
 protected:
+    inline std::vector<float> getFeaturesIntoVector(utils::Rotation rotation) const
+    {
+        std::vector<float> features(getNumInputChannels() * getInputChannelHeight() * getInputChannelWidth());
+        getFeaturesInto(features.data(), rotation);
+        return features;
+    }
+
     Player turn_;
     std::vector<Action> actions_;
     std::vector<std::string> observations_;
 };
 
+// environment snapshots of one game record, where checkpoint i is the environment after (i + 1) * learner_env_checkpoint_interval actions
+// the cache is owned by a single record, copying a record starts with an empty cache
+// the checkpoints of all records share a memory budget of learner_env_checkpoint_cache_memory_mb, when it is exceeded,
+// the checkpoints of whole records are evicted by the clock algorithm, so that the records sampled recently keep theirs
+template <class Env>
+class EnvCheckpoints {
+public:
+    EnvCheckpoints() : memory_size_(0), is_registered_(false), referenced_(false) {}
+    EnvCheckpoints(const EnvCheckpoints&) : EnvCheckpoints() {}
+    EnvCheckpoints& operator=(const EnvCheckpoints&)
+    {
+        clear();
+        return *this;
+    }
+    ~EnvCheckpoints() { clear(); }
+
+    inline void clear()
+    {
+        Pool& pool = getPool();
+        std::lock_guard<std::mutex> pool_lock(pool.mutex_);
+        evict(pool);
+    }
+
+    // return the latest checkpoint whose index is not larger than index, or nullptr if there is no such checkpoint
+    inline std::shared_ptr<const Env> get(int index, int& checkpoint_index) const
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        referenced_ = true;
+        checkpoint_index = std::min(index, static_cast<int>(checkpoints_.size()) - 1);
+        return (checkpoint_index >= 0 ? checkpoints_[checkpoint_index] : nullptr);
+    }
+
+    // checkpoints are only appended in order, the checkpoints of other records are evicted to keep them within the budget
+    inline void add(int index, const Env& env)
+    {
+        const size_t budget = static_cast<size_t>(std::max(0, minizero::config::learner_env_checkpoint_cache_memory_mb)) * 1024 * 1024;
+        const size_t checkpoint_size = sizeof(Env) + env.getHeapMemorySize();
+        Pool& pool = getPool();
+        std::lock_guard<std::mutex> pool_lock(pool.mutex_);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (index != static_cast<int>(checkpoints_.size())) { return; }
+        }
+        while (pool.memory_size_ + checkpoint_size > budget && evictNext(pool)) {}
+        if (pool.memory_size_ + checkpoint_size > budget) { return; }
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        checkpoints_.push_back(std::make_shared<const Env>(env));
+        memory_size_ += checkpoint_size;
+        pool.memory_size_ += checkpoint_size;
+        if (!is_registered_) {
+            position_ = pool.records_.insert(pool.clock_hand_, this); // the newest record is the last one reached by the clock hand
+            is_registered_ = true;
+        }
+    }
+
+private:
+    // the records holding checkpoints, guarded by its mutex, which is always locked before the mutex of a record
+    class Pool {
+    public:
+        Pool() : memory_size_(0), clock_hand_(records_.end()) {}
+
+        std::mutex mutex_;
+        size_t memory_size_;
+        std::list<EnvCheckpoints*> records_;
+        typename std::list<EnvCheckpoints*>::iterator clock_hand_;
+    };
+
+    static inline Pool& getPool()
+    {
+        static Pool* pool = new Pool(); // never destroyed, since records may outlive static objects
+        return *pool;
+    }
+
+    // evict the first record not referenced since the clock hand passed it, returns false if there is none but this record
+    inline bool evictNext(Pool& pool)
+    {
+        for (size_t i = 0; i < 2 * pool.records_.size(); ++i) {
+            if (pool.clock_hand_ == pool.records_.end()) { pool.clock_hand_ = pool.records_.begin(); }
+            EnvCheckpoints* record = *pool.clock_hand_;
+            if (record == this || record->referenced_.exchange(false)) {
+                ++pool.clock_hand_;
+                continue;
+            }
+            record->evict(pool);
+            return true;
+        }
+        return false;
+    }
+
+    inline void evict(Pool& pool)
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (is_registered_) {
+            if (pool.clock_hand_ == position_) { ++pool.clock_hand_; }
+            pool.records_.erase(position_);
+            is_registered_ = false;
+        }
+        pool.memory_size_ -= memory_size_;
+        memory_size_ = 0;
+        checkpoints_.clear();
+    }
+
+    mutable std::mutex mutex_;
+    std::vector<std::shared_ptr<const Env>> checkpoints_;
+    size_t memory_size_;
+    bool is_registered_; // guarded by the mutex of the pool
+    typename std::list<EnvCheckpoints*>::iterator position_;
+    mutable std::atomic<bool> referenced_;
+};
+
 template <class Action, class Env>
 class BaseEnvLoader {
 public:
@@ -128,6 +269,7 @@ public:
         tags_.insert({"GM", name()});
         tags_.insert({"RE", "0"});
         action_pairs_.clear();
+        env_checkpoints_.clear();
     }
 
     virtual bool loadFromFile(const std::string& file_name)
@@ -232,10 +374,12 @@ public:
 
     virtual std::vector<float> getFeatures(const int pos, utils::Rotation rotation = utils::Rotation::kRotationNone) const
     {
-        // a slow but naive method which simply replays the game again to get features
-        Env env;
-        for (int i = 0; i < std::min(pos, static_cast<int>(action_pairs_.size())); ++i) { env.act(action_pairs_[i].first); }
-        return env.getFeatures(rotation);
+        return replayEnvironment(pos).getFeatures(rotation);
+    }
+
+    virtual void getFeaturesInto(const int pos, float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const
+    {
+        replayEnvironment(pos).getFeaturesInto(features, rotation);
     }
 
     virtual std::vector<float> getPolicy(const int pos, utils::Rotation rotation = utils::Rotation::kRotationNone) const
@@ -298,6 +442,30 @@ public:
     inline float getReturn() const { return std::stof(getTag("RE")); }
 
 protected:
+    // reset the environment to the beginning of the record
+    virtual void resetReplayEnvironment(Env& env) const {}
+
+    Env replayEnvironment(const int pos) const
+    {
+        // replay the game from the nearest checkpoint, and store new checkpoints along the way
+        const int end = std::min(pos, static_cast<int>(action_pairs_.size()));
+        const int interval = minizero::config::learner_env_checkpoint_interval;
+        Env env;
+        int start = 0, checkpoint_index = -1;
+        std::shared_ptr<const Env> checkpoint = (interval > 0 ? env_checkpoints_.get(end / interval - 1, checkpoint_index) : nullptr);
+        if (checkpoint) {
+            env = *checkpoint;
+            start = (checkpoint_index + 1) * interval;
+        } else {
+            resetReplayEnvironment(env);
+        }
+        for (int i = start; i < end; ++i) {
+            env.act(action_pairs_[i].first);
+            if (interval > 0 && (i + 1) % interval == 0) { env_checkpoints_.add((i + 1) / interval - 1, env); }
+        }
+        return env;
+    }
+
     std::string escapeSGFString(const std::string& str) const
     {
         std::string special = "()[]\\";
@@ -314,6 +482,7 @@ protected:
     std::string sgf_content_;
     Tags tags_;
     std::vector<std::pair<Action, ActionInfo>> action_pairs_;
+    mutable EnvCheckpoints<Env> env_checkpoints_;
 };
 
 template <int kNumPlayer = 2>
@@ -49,7 +49,8 @@ public:
     bool isTerminal() const override;
     float getReward() const override { return 0.0f; }
     float getEvalScore(bool is_resign = false) const override;
-    std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
+    inline std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override { return getFeaturesIntoVector(rotation); }
+    void getFeaturesInto(float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     std::vector<float> getActionFeatures(const GoAction& action, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     inline int getNumInputChannels() const override { return 18; }
     inline int getPolicySize() const override { return getBoardSize() * getBoardSize() + 1; }
@@ -72,6 +73,12 @@ public:
     inline const std::vector<GamePair<GoBitboard>>& getStoneBitboardHistory() const { return stone_bitboard_history_; }
     inline const std::vector<GoHashKey>& getHashKeyHistory() const { return hashkey_history_; }
     inline const std::unordered_set<GoHashKey>& getHashTable() const { return hash_table_; }
+    inline size_t getHeapMemorySize() const override
+    {
+        return BaseBoardEnv<GoAction>::getHeapMemorySize() + grids_.capacity() * sizeof(GoGrid) + areas_.capacity() * sizeof(GoArea) + blocks_.capacity() * sizeof(GoBlock)
+               + stone_bitboard_history_.capacity() * sizeof(GamePair<GoBitboard>) + hashkey_history_.capacity() * sizeof(GoHashKey)
+               + hash_table_.bucket_count() * sizeof(void*) + hash_table_.size() * (sizeof(GoHashKey) + 2 * sizeof(void*));
+    }
 
     inline int getRotatePosition(int position, utils::Rotation rotation) const override { return utils::getPositionByRotating(rotation, position, getBoardSize()); };
     inline int getRotateAction(int action_id, utils::Rotation rotation) const override { return getRotatePosition(action_id, rotation); };
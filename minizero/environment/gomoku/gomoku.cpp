@@ -35,6 +35,16 @@ bool GomokuEnv::act(const std::vector<std::string>& action_string_args)
     return act(GomokuAction(action_string_args));
 }
 
+void GomokuEnv::undo()
+{
+    assert(!actions_.empty());
+    const int action_id = actions_.back().getActionID();
+    turn_ = actions_.back().getPlayer();
+    actions_.pop_back();
+    board_[action_id] = Player::kPlayerNone;
+    winner_ = Player::kPlayerNone; // no action can be played after the game is decided
+}
+
 std::vector<GomokuAction> GomokuEnv::getLegalActions() const
 {
     std::vector<GomokuAction> actions;
@@ -72,29 +82,27 @@ float GomokuEnv::getEvalScore(bool is_resign /*= false*/) const
     }
 }
 
-std::vector<float> GomokuEnv::getFeatures(utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
+void GomokuEnv::getFeaturesInto(float* features, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
 {
     /* 4 channels:
         0~1. own/opponent position
         2. Black's turn
         3. White's turn
     */
-    std::vector<float> features;
     for (int channel = 0; channel < 4; ++channel) {
         for (int pos = 0; pos < board_size_ * board_size_; ++pos) {
             int rotation_pos = getRotatePosition(pos, utils::reversed_rotation[static_cast<int>(rotation)]);
             if (channel == 0) {
-                features.push_back((board_[rotation_pos] == turn_ ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (board_[rotation_pos] == turn_ ? 1.0f : 0.0f);
             } else if (channel == 1) {
-                features.push_back((board_[rotation_pos] == getNextPlayer(turn_, kGomokuNumPlayer) ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (board_[rotation_pos] == getNextPlayer(turn_, kGomokuNumPlayer) ? 1.0f : 0.0f);
             } else if (channel == 2) {
-                features.push_back((turn_ == Player::kPlayer1 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (turn_ == Player::kPlayer1 ? 1.0f : 0.0f);
             } else if (channel == 3) {
-                features.push_back((turn_ == Player::kPlayer2 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (turn_ == Player::kPlayer2 ? 1.0f : 0.0f);
             }
         }
     }
-    return features;
 }
 
 std::vector<float> GomokuEnv::getActionFeatures(const GomokuAction& action, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
@@ -25,12 +25,15 @@ public:
     void reset() override;
     bool act(const GomokuAction& action) override;
     bool act(const std::vector<std::string>& action_string_args) override;
+    inline bool supportUndo() const override { return true; }
+    void undo() override;
     std::vector<GomokuAction> getLegalActions() const override;
     bool isLegalAction(const GomokuAction& action) const override;
     bool isTerminal() const override;
     float getReward() const override { return 0.0f; }
     float getEvalScore(bool is_resign = false) const override;
-    std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
+    inline std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override { return getFeaturesIntoVector(rotation); }
+    void getFeaturesInto(float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     std::vector<float> getActionFeatures(const GomokuAction& action, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     inline int getNumInputChannels() const override { return 4; }
     inline int getPolicySize() const override { return getBoardSize() * getBoardSize(); }
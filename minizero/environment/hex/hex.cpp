@@ -15,6 +15,8 @@ void HexEnv::reset()
     winner_ = Player::kPlayerNone;
     turn_ = Player::kPlayer1;
     actions_.clear();
+    changed_cells_.clear();
+    undo_history_.clear();
     board_.resize(board_size_ * board_size_);
     fill(board_.begin(), board_.end(), Cell{Player::kPlayerNone, (Flag)0});
 }
@@ -24,6 +26,7 @@ bool HexEnv::act(const HexAction& action)
     if (!isLegalAction(action)) { return false; }
 
     int action_id = action.getActionID();
+    undo_history_.emplace_back(changed_cells_.size(), winner_);
 
     if (config::env_hex_use_swap_rule) {
         // Check if it's the second move and the chosen action is same as the first action
@@ -39,6 +42,7 @@ bool HexEnv::act(const HexAction& action)
             int reflected_id = reflected_row * board_size_ + reflected_col;
 
             // Clear original move
+            saveCell(actions_[0].getActionID());
             board_[actions_[0].getActionID()].player = Player::kPlayerNone;
             board_[actions_[0].getActionID()].flags = Flag::NONE;
 
@@ -46,6 +50,7 @@ bool HexEnv::act(const HexAction& action)
         }
     }
 
+    saveCell(action_id);
     Cell* cc{&board_[action_id]};
     cc->player = action.getPlayer();
     if (cc->player == Player::kPlayer1) {
@@ -72,6 +77,17 @@ bool HexEnv::act(const std::vector<std::string>& action_string_args)
     return act(HexAction(action_string_args));
 }
 
+void HexEnv::undo()
+{
+    // restore the changed cells in reverse order, so that a cell changed several times gets its oldest value
+    assert(!actions_.empty() && actions_.size() == undo_history_.size());
+    for (; changed_cells_.size() > undo_history_.back().first; changed_cells_.pop_back()) { board_[changed_cells_.back().first] = changed_cells_.back().second; }
+    winner_ = undo_history_.back().second;
+    turn_ = actions_.back().getPlayer();
+    actions_.pop_back();
+    undo_history_.pop_back();
+}
+
 std::vector<HexAction> HexEnv::getLegalActions() const
 {
     std::vector<HexAction> actions;
@@ -115,29 +131,27 @@ float HexEnv::getEvalScore(bool is_resign /* = false */) const
     }
 }
 
-std::vector<float> HexEnv::getFeatures(utils::Rotation rotation /* = utils::Rotation::kRotationNone */) const
+void HexEnv::getFeaturesInto(float* features, utils::Rotation rotation /* = utils::Rotation::kRotationNone */) const
 {
     /* 4 channels:
         0~1. own/opponent position
         2. Black's turn
         3. White's turn
     */
-    std::vector<float> features;
     for (int channel = 0; channel < 4; ++channel) {
         for (int pos = 0; pos < board_size_ * board_size_; ++pos) {
             int rotation_pos = pos;
             if (channel == 0) {
-                features.push_back((board_[rotation_pos].player == turn_ ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (board_[rotation_pos].player == turn_ ? 1.0f : 0.0f);
             } else if (channel == 1) {
-                features.push_back((board_[rotation_pos].player == getNextPlayer(turn_, kHexNumPlayer) ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (board_[rotation_pos].player == getNextPlayer(turn_, kHexNumPlayer) ? 1.0f : 0.0f);
             } else if (channel == 2) {
-                features.push_back((turn_ == Player::kPlayer1 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (turn_ == Player::kPlayer1 ? 1.0f : 0.0f);
             } else if (channel == 3) {
-                features.push_back((turn_ == Player::kPlayer2 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (turn_ == Player::kPlayer2 ? 1.0f : 0.0f);
             }
         }
     }
-    return features;
 }
 
 std::vector<float> HexEnv::getActionFeatures(const HexAction& action, utils::Rotation rotation /* = utils::Rotation::kRotationNone */) const
@@ -336,6 +350,7 @@ Player HexEnv::updateWinner(int action_id)
     }
 
     // Update from surrounding cells.
+    if (changed_cells_.back().first != action_id) { saveCell(action_id); } // the played cell is already saved by act()
     Cell* my_cell = &board_[action_id];
     for (size_t ii = 0; ii < neighboor_cells_actions.size(); ii++) {
         Cell* neighboor{&board_[neighboor_cells_actions[ii]]};
@@ -3,6 +3,7 @@
 #include "base_env.h"
 #include "configuration.h"
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace minizero::env::hex {
@@ -42,12 +43,15 @@ public:
     void reset() override;
     bool act(const HexAction& action) override;
     bool act(const std::vector<std::string>& action_string_args) override;
+    inline bool supportUndo() const override { return true; }
+    void undo() override;
     std::vector<HexAction> getLegalActions() const override;
     bool isLegalAction(const HexAction& action) const override;
     bool isTerminal() const override;
     float getReward() const override { return 0.0f; }
     float getEvalScore(bool is_resign = false) const override;
-    std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
+    inline std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override { return getFeaturesIntoVector(rotation); }
+    void getFeaturesInto(float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     std::vector<float> getActionFeatures(const HexAction& action, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     inline int getNumInputChannels() const override { return 4; }
     inline int getPolicySize() const override { return getBoardSize() * getBoardSize(); }
@@ -63,9 +67,12 @@ public:
 
 private:
     Player updateWinner(int actionID);
+    inline void saveCell(int position) { changed_cells_.emplace_back(position, board_[position]); }
 
     Player winner_;
     std::vector<Cell> board_;
+    std::vector<std::pair<int, Cell>> changed_cells_; // the cells before they are changed by the actions, for undo
+    std::vector<std::pair<size_t, Player>> undo_history_; // the number of changed cells and the winner before each action
 };
 
 class HexEnvLoader : public BaseBoardEnvLoader<HexAction, HexEnv> {
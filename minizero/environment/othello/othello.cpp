@@ -14,6 +14,7 @@ void OthelloEnv::reset()
 {
     turn_ = Player::kPlayer1;
     actions_.clear();
+    flip_history_.clear();
     legal_pass_.set(false, false);
     board_.reset();
     legal_board_.reset();
@@ -102,14 +103,16 @@ OthelloBitboard OthelloEnv::getCanPutPoint(
 // set the piece and flip the relevent pieces, then update the candidate board for black and white
 bool OthelloEnv::act(const OthelloAction& action)
 {
-    OthelloBitboard empty_board;
     OthelloBitboard placed_pos; // the position that action placed
     OthelloBitboard flip;       // pieces ready to flip
 
     if (!isLegalAction(action)) { return false; }
     actions_.push_back(action);
     turn_ = action.nextPlayer();
-    if (isPassAction(action)) { return true; }
+    if (isPassAction(action)) {
+        flip_history_.emplace_back();
+        return true;
+    }
 
     Player player = action.getPlayer();
     board_.get(player).set(action.getActionID(), 1);
@@ -125,18 +128,40 @@ bool OthelloEnv::act(const OthelloAction& action)
 
     board_.get(player) |= flip;
     board_.get(getNextPlayer(player, kOthelloNumPlayer)) &= ~flip;
+    flip_history_.push_back(flip);
+    updateLegalBoard(player);
+    return true;
+}
+
+void OthelloEnv::undo()
+{
+    assert(!actions_.empty() && actions_.size() == flip_history_.size());
+    const OthelloAction action = actions_.back();
+    const OthelloBitboard flip = flip_history_.back();
+    actions_.pop_back();
+    flip_history_.pop_back();
+    turn_ = action.getPlayer();
+    if (isPassAction(action)) { return; }
 
+    Player player = action.getPlayer();
+    board_.get(player).set(action.getActionID(), 0);
+    board_.get(player) &= ~flip;
+    board_.get(getNextPlayer(player, kOthelloNumPlayer)) |= flip;
+    updateLegalBoard(player);
+}
+
+void OthelloEnv::updateLegalBoard(Player player)
+{
     // update legal action bitboard
-    empty_board = (one_board_ ^ (board_.get(Player::kPlayer1) | board_.get(Player::kPlayer2))); // places with no pieces
-    legal_board_.get(Player::kPlayer1).reset();                                                 // store the candidate of the legal bitboard
-    legal_board_.get(Player::kPlayer2).reset();                                                 // store the candidate of the legal bitboard
+    OthelloBitboard empty_board = (one_board_ ^ (board_.get(Player::kPlayer1) | board_.get(Player::kPlayer2))); // places with no pieces
+    legal_board_.get(Player::kPlayer1).reset();                                                                 // store the candidate of the legal bitboard
+    legal_board_.get(Player::kPlayer2).reset();                                                                 // store the candidate of the legal bitboard
     for (int i = 0; i < 8; i++) {
         legal_board_.get(player) |= getCanPutPoint(dir_step_[i], mask_[i], empty_board, board_.get(getNextPlayer(player, kOthelloNumPlayer)), board_.get(player));
         legal_board_.get(getNextPlayer(player, kOthelloNumPlayer)) |= getCanPutPoint(dir_step_[i], mask_[i], empty_board, board_.get(player), board_.get(getNextPlayer(player, kOthelloNumPlayer)));
     } // generate the legal bitboard
     legal_pass_.get(Player::kPlayer1) = legal_board_.get(Player::kPlayer1).none();
     legal_pass_.get(Player::kPlayer2) = legal_board_.get(Player::kPlayer2).none();
-    return true;
 }
 
 bool OthelloEnv::act(const std::vector<std::string>& action_string_args)
@@ -234,24 +259,22 @@ Player OthelloEnv::eval() const
         return Player::kPlayerNone;
     }
 }
-std::vector<float> OthelloEnv::getFeatures(utils::Rotation rotation) const
+void OthelloEnv::getFeaturesInto(float* features, utils::Rotation rotation) const
 {
-    std::vector<float> features;
     for (int channel = 0; channel < 4; ++channel) {
         for (int pos = 0; pos < board_size_ * board_size_; ++pos) {
             int rotation_pos = getRotatePosition(pos, utils::reversed_rotation[static_cast<int>(rotation)]);
             if (channel == 0) {
-                features.push_back((board_.get(turn_)[rotation_pos] == 1 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (board_.get(turn_)[rotation_pos] == 1 ? 1.0f : 0.0f);
             } else if (channel == 1) {
-                features.push_back((board_.get(getNextPlayer(turn_, kOthelloNumPlayer))[rotation_pos] == 1 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (board_.get(getNextPlayer(turn_, kOthelloNumPlayer))[rotation_pos] == 1 ? 1.0f : 0.0f);
             } else if (channel == 2) {
-                features.push_back((turn_ == Player::kPlayer1 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (turn_ == Player::kPlayer1 ? 1.0f : 0.0f);
             } else if (channel == 3) {
-                features.push_back((turn_ == Player::kPlayer2 ? 1.0f : 0.0f));
+                features[channel * board_size_ * board_size_ + pos] = (turn_ == Player::kPlayer2 ? 1.0f : 0.0f);
             }
         }
     }
-    return features;
 }
 
 std::vector<float> OthelloEnv::getActionFeatures(const OthelloAction& action, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
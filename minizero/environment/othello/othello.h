@@ -28,12 +28,15 @@ public:
     void reset() override;
     bool act(const OthelloAction& action) override;
     bool act(const std::vector<std::string>& action_string_args) override;
+    inline bool supportUndo() const override { return true; }
+    void undo() override;
     std::vector<OthelloAction> getLegalActions() const override;
     bool isLegalAction(const OthelloAction& action) const override;
     bool isTerminal() const override;
     float getReward() const override { return 0.0f; }
     float getEvalScore(bool is_resign = false) const override;
-    std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
+    inline std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override { return getFeaturesIntoVector(rotation); }
+    void getFeaturesInto(float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     std::vector<float> getActionFeatures(const OthelloAction& action, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     inline int getNumInputChannels() const override { return 4; }
     inline int getPolicySize() const override { return getBoardSize() * getBoardSize() + 1; }
@@ -60,14 +63,16 @@ private:
         OthelloBitboard opponent_board,
         OthelloBitboard player_board);
     OthelloBitboard getCandidateAlongDirectionBoard(int direction, OthelloBitboard candidate);
+    void updateLegalBoard(Player player);
     std::string getCoordinateString() const;
 
     int dir_step_[8]; // 8 directions
     OthelloBitboard one_board_;
-    OthelloBitboard mask_[8];               // 8 directions
-    GamePair<bool> legal_pass_;             // store black/white legal pass
-    GamePair<OthelloBitboard> legal_board_; // store black/white legal board
-    GamePair<OthelloBitboard> board_;       // store black/white board
+    OthelloBitboard mask_[8];                   // 8 directions
+    GamePair<bool> legal_pass_;                 // store black/white legal pass
+    GamePair<OthelloBitboard> legal_board_;     // store black/white legal board
+    GamePair<OthelloBitboard> board_;           // store black/white board
+    std::vector<OthelloBitboard> flip_history_; // pieces flipped by each action, for undo
 };
 
 class OthelloEnvLoader : public BaseBoardEnvLoader<OthelloAction, OthelloEnv> {
@@ -110,16 +110,14 @@ bool Puzzle2048Env::isTerminal() const
     return true;
 }
 
-std::vector<float> Puzzle2048Env::getFeatures(utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
+void Puzzle2048Env::getFeaturesInto(float* features, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
 {
     // 16 channels: the nth channel represents the position of the nth tile
-    std::vector<float> features;
     for (int tile = 0; tile < 16; ++tile) {
         for (int pos = 0; pos < 16; ++pos) {
-            features.push_back(board_.get(getRotatePosition(pos, utils::reversed_rotation[static_cast<int>(rotation)])) == tile ? 1.0f : 0.0f);
+            features[tile * 16 + pos] = (board_.get(getRotatePosition(pos, utils::reversed_rotation[static_cast<int>(rotation)])) == tile ? 1.0f : 0.0f);
         }
     }
-    return features;
 }
 
 std::vector<float> Puzzle2048Env::getActionFeatures(const Puzzle2048Action& action, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
@@ -160,8 +158,7 @@ std::vector<float> Puzzle2048EnvLoader::getChanceEventFeatures(const int pos, ut
     Puzzle2048Env env;
     Puzzle2048Action event;
     if (pos < static_cast<int>(action_pairs_.size())) {
-        env.reset(getSeed());
-        for (int i = 0; i <= std::min<int>(pos, action_pairs_.size() - 1); ++i) { env.act(action_pairs_[i].first); }
+        env = replayEnvironment(pos + 1);
         event = env.getChanceEventHistory().back();
     } else { // absorbing states
         event = Puzzle2048ChanceEvent(utils::Random::randInt() % 16, utils::Random::randInt() % 10 ? 1 : 2);
@@ -173,9 +170,7 @@ std::vector<float> Puzzle2048EnvLoader::getChance(const int pos, utils::Rotation
 {
     std::vector<float> chance(getChanceEventSize(), 0.0f);
     if (pos < static_cast<int>(action_pairs_.size())) {
-        Puzzle2048Env env;
-        env.reset(getSeed());
-        for (int i = 0; i <= std::min<int>(pos, action_pairs_.size() - 1); ++i) { env.act(action_pairs_[i].first); }
+        Puzzle2048Env env = replayEnvironment(pos + 1);
         Puzzle2048ChanceEvent rotated_event = getRotateChanceEvent(env.getChanceEventHistory().back().getActionID(), rotation);
         chance[rotated_event.getActionID() - env.getPolicySize()] = 1.0f;
     } else { // absorbing states
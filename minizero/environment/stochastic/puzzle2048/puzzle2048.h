@@ -112,7 +112,8 @@ public:
         Puzzle2048ChanceEvent event(event_id);
         return Puzzle2048ChanceEvent(getRotatePosition(event.getPosition(), rotation), event.getTile()).getActionID();
     }
-    std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
+    inline std::vector<float> getFeatures(utils::Rotation rotation = utils::Rotation::kRotationNone) const override { return getFeaturesIntoVector(rotation); }
+    void getFeaturesInto(float* features, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     std::vector<float> getActionFeatures(const Puzzle2048Action& action, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     std::vector<float> getChanceEventFeatures(const Puzzle2048Action& event, utils::Rotation rotation = utils::Rotation::kRotationNone) const override;
     inline int getNumInputChannels() const override { return 16; }
@@ -54,23 +54,10 @@ public:
 
     inline int getSeed() const { return std::stoi(BaseEnvLoader<Action, Env>::getTag("SD")); }
 
-    std::vector<float> getFeatures(const int pos, utils::Rotation rotation = utils::Rotation::kRotationNone) const override
-    {
-        // a slow but naive method which simply replays the game again to get features
-        Env env;
-        env.reset(getSeed());
-        const auto& action_pairs_ = BaseEnvLoader<Action, Env>::action_pairs_;
-        for (int i = 0; i < std::min(pos, static_cast<int>(action_pairs_.size())); ++i) { env.act(action_pairs_[i].first); }
-        return env.getFeatures(rotation);
-    }
-
     virtual std::vector<float> getAfterstateFeatures(const int pos, utils::Rotation rotation) const
     {
-        // a slow but naive method which simply replays the game again to get features
-        Env env;
-        env.reset(getSeed());
+        Env env = BaseEnvLoader<Action, Env>::replayEnvironment(pos);
         const auto& action_pairs_ = BaseEnvLoader<Action, Env>::action_pairs_;
-        for (int i = 0; i < std::min(pos, static_cast<int>(action_pairs_.size())); ++i) { env.act(action_pairs_[i].first); }
         if (!env.isTerminal() && pos < static_cast<int>(action_pairs_.size())) { env.act(action_pairs_[pos].first, false); }
         return env.getFeatures(rotation);
     }
@@ -80,6 +67,9 @@ public:
     virtual std::vector<float> getAfterstateValue(const int pos) const = 0;
     virtual int getChanceEventSize() const = 0;
     virtual int getRotateChanceEvent(int event_id, utils::Rotation rotation) const = 0;
+
+protected:
+    void resetReplayEnvironment(Env& env) const override { env.reset(getSeed()); }
 };
 
 } // namespace minizero::env
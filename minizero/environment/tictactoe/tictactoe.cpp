@@ -30,6 +30,15 @@ bool TicTacToeEnv::act(const std::vector<std::string>& action_string_args)
     return act(TicTacToeAction(action_string_args));
 }
 
+void TicTacToeEnv::undo()
+{
+    assert(!actions_.empty());
+    const int action_id = actions_.back().getActionID();
+    turn_ = actions_.back().getPlayer();
+    actions_.pop_back();
+    board_[action_id] = Player::kPlayerNone;
+}
+
 std::vector<TicTacToeAction> TicTacToeEnv::getLegalActions() const
 {
     std::vector<TicTacToeAction> actions;
@@ -64,29 +73,27 @@ float TicTacToeEnv::getEvalScore(bool is_resign /*= false*/) const
     }
 }
 
-std::vector<float> TicTacToeEnv::getFeatures(utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
+void TicTacToeEnv::getFeaturesInto(float* features, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
 {
     /* 4 channels:
         0~1. own/opponent position
         2. Nought turn
         3. Cross turn
     */
-    std::vector<float> features;
     for (int channel = 0; channel < 4; ++channel) {
         for (int pos = 0; pos < kTicTacToeBoardSize * kTicTacToeBoardSize; ++pos) {
             int rotation_pos = getRotatePosition(pos, utils::reversed_rotation[static_cast<int>(rotation)]);
             if (channel == 0) {
-                features.push_back((board_[rotation_pos] == turn_ ? 1.0f : 0.0f));
+                features[channel * kTicTacToeBoardSize * kTicTacToeBoardSize + pos] = (board_[rotation_pos] == turn_ ? 1.0f : 0.0f);
             } else if (channel == 1) {
-                features.push_back((board_[rotation_pos] == getNextPlayer(turn_, kTicTacToeNumPlayer) ? 1.0f : 0.0f));
+                features[channel * kTicTacToeBoardSize * kTicTacToeBoardSize + pos] = (board_[rotation_pos] == getNextPlayer(turn_, kTicTacToeNumPlayer) ? 1.0f : 0.0f);
             } else if (channel == 2) {
-                features.push_back((turn_ == Player::kPlayer1 ? 1.0f : 0.0f));
+                features[channel * kTicTacToeBoardSize * kTicTacToeBoardSize + pos] = (turn_ == Player::kPlayer1 ? 1.0f : 0.0f);
             } else if (channel == 3) {
-                features.push_back((turn_ == Player::kPlayer2 ? 1.0f : 0.0f));
+                features[channel * kTicTacToeBoardSize * kTicTacToeBoardSize + pos] = (turn_ == Player::kPlayer2 ? 1.0f : 0.0f);
             }
         }
     }
-    return features;
 }
 
 std::vector<float> TicTacToeEnv::getActionFeatures(const TicTacToeAction& action, utils::Rotation rotation /*= utils::Rotation::kRotationNone*/) const
@@ -5,6 +5,7 @@
 #include "rotation.h"
 #include <algorithm>
 #include <fstream>
+#include <unordered_map>
 #include <utility>
 
 namespace minizero::learner {
@@ -15,8 +16,8 @@ using namespace minizero::utils;
 ReplayBuffer::ReplayBuffer()
 {
     num_data_ = 0;
-    game_priority_sum_ = 0.0f;
-    game_priorities_.clear();
+    next_env_id_ = 0;
+    game_priorities_.reset(0);
     position_priorities_.clear();
     env_loaders_.clear();
 }
@@ -24,43 +25,49 @@ ReplayBuffer::ReplayBuffer()
 void ReplayBuffer::addData(const EnvironmentLoader& env_loader)
 {
     std::pair<int, int> data_range = env_loader.getDataRange();
-    std::deque<float> position_priorities(data_range.second + 1, 0.0f);
-    float game_priority = 0.0f;
+    utils::SumTree position_priorities(data_range.second + 1);
     for (int i = data_range.first; i <= data_range.second; ++i) {
-        position_priorities[i] = std::pow((config::learner_use_per ? env_loader.getPriority(i) : 1.0f), config::learner_per_alpha);
-        game_priority += position_priorities[i];
+        position_priorities.update(i, std::pow((config::learner_use_per ? env_loader.getPriority(i) : 1.0f), config::learner_per_alpha));
     }
 
     std::lock_guard<std::mutex> lock(mutex_);
 
-    // add new data to replay buffer
+    const int replay_buffer_max_size = config::zero_replay_buffer * config::zero_num_games_per_iteration;
+    if (game_priorities_.getCapacity() == 0) { game_priorities_.reset(replay_buffer_max_size); }
+
+    // add new data to replay buffer, overwrite the oldest one if replay buffer is full
+    int env_id = next_env_id_;
+    next_env_id_ = (next_env_id_ + 1) % replay_buffer_max_size;
     num_data_ += (data_range.second - data_range.first + 1);
-    position_priorities_.push_back(position_priorities);
-    game_priorities_.push_back(game_priority);
-    env_loaders_.push_back(env_loader);
-
-    // remove old data if replay buffer is full
-    const size_t replay_buffer_max_size = config::zero_replay_buffer * config::zero_num_games_per_iteration;
-    while (position_priorities_.size() > replay_buffer_max_size) {
-        data_range = env_loaders_.front().getDataRange();
-        num_data_ -= (data_range.second - data_range.first + 1);
-        position_priorities_.pop_front();
-        game_priorities_.pop_front();
-        env_loaders_.pop_front();
+    if (env_id < static_cast<int>(env_loaders_.size())) {
+        std::pair<int, int> old_data_range = env_loaders_[env_id].getDataRange();
+        num_data_ -= (old_data_range.second - old_data_range.first + 1);
+        position_priorities_[env_id] = std::move(position_priorities);
+        env_loaders_[env_id] = env_loader;
+    } else {
+        position_priorities_.push_back(std::move(position_priorities));
+        env_loaders_.push_back(env_loader);
     }
+    game_priorities_.update(env_id, position_priorities_[env_id].getSum());
 }
 
-std::pair<int, int> ReplayBuffer::sampleEnvAndPos()
+void ReplayBuffer::updatePositionPriority(int env_id, int pos, float priority)
 {
-    int env_id = sampleIndex(game_priorities_);
-    int pos_id = sampleIndex(position_priorities_[env_id]);
-    return {env_id, pos_id};
+    // caller should guarantee that no other thread updates the same game at the same time
+    position_priorities_[env_id].update(pos, priority);
 }
 
-int ReplayBuffer::sampleIndex(const std::deque<float>& weight)
+void ReplayBuffer::updateGamePriority(int env_id)
 {
-    std::discrete_distribution<> dis(weight.begin(), weight.end());
-    return dis(Random::generator_);
+    std::lock_guard<std::mutex> lock(mutex_);
+    game_priorities_.update(env_id, position_priorities_[env_id].getSum());
+}
+
+std::pair<int, int> ReplayBuffer::sampleEnvAndPos()
+{
+    int env_id = game_priorities_.sample(Random::randReal(game_priorities_.getSum()));
+    int pos_id = position_priorities_[env_id].sample(Random::randReal(position_priorities_[env_id].getSum()));
+    return {env_id, pos_id};
 }
 
 float ReplayBuffer::getLossScale(const std::pair<int, int>& p)
@@ -69,7 +76,7 @@ float ReplayBuffer::getLossScale(const std::pair<int, int>& p)
 
     // calculate importance sampling ratio
     int env_id = p.first, pos = p.second;
-    float prob = position_priorities_[env_id][pos] / game_priority_sum_;
+    float prob = position_priorities_[env_id].get(pos) / game_priorities_.getSum();
     return std::pow((num_data_ * prob), (-config::learner_per_init_beta));
 }
 
@@ -90,6 +97,12 @@ int DataLoaderSharedData::getNextBatchIndex()
     return (batch_index_ < config::learner_batch_size ? batch_index_++ : config::learner_batch_size);
 }
 
+int DataLoaderSharedData::getNextPriorityUpdateGroupIndex()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    return (priority_update_group_index_ < static_cast<int>(priority_update_groups_.size()) ? priority_update_group_index_++ : priority_update_groups_.size());
+}
+
 void DataLoaderThread::initialize()
 {
     int seed = config::program_auto_seed ? std::random_device()() : config::program_seed + id_;
@@ -100,6 +113,8 @@ void DataLoaderThread::runJob()
 {
     if (!getSharedData()->env_strings_.empty()) {
         while (addEnvironmentLoader()) {}
+    } else if (!getSharedData()->priority_update_groups_.empty()) {
+        while (updatePriority()) {}
     } else {
         while (sampleData()) {}
     }
@@ -131,6 +146,29 @@ bool DataLoaderThread::sampleData()
     return true;
 }
 
+bool DataLoaderThread::updatePriority()
+{
+    int group_index = getSharedData()->getNextPriorityUpdateGroupIndex();
+    if (group_index >= static_cast<int>(getSharedData()->priority_update_groups_.size())) { return false; }
+
+    // all batch indices in a group belong to the same game, so that only this thread modifies it
+    const int* sampled_index = getSharedData()->priority_update_sampled_index_;
+    const float* batch_values = getSharedData()->priority_update_batch_values_;
+    const std::vector<int>& group = getSharedData()->priority_update_groups_[group_index];
+    int env_id = sampled_index[2 * group[0]];
+    EnvironmentLoader& env_loader = getSharedData()->replay_buffer_.env_loaders_[env_id];
+    for (int batch_index : group) {
+        int pos_id = sampled_index[2 * batch_index + 1];
+        for (int step = 0; step <= config::learner_muzero_unrolling_step; ++step) {
+            float new_value = utils::invertValue(batch_values[step * config::learner_batch_size + batch_index]);
+            env_loader.setActionPairInfo(pos_id + step, "V", std::to_string(new_value));
+        }
+        getSharedData()->replay_buffer_.updatePositionPriority(env_id, pos_id, std::pow(env_loader.getPriority(pos_id), config::learner_per_alpha));
+    }
+    getSharedData()->replay_buffer_.updateGamePriority(env_id);
+    return true;
+}
+
 void DataLoaderThread::setAlphaZeroTrainingData(int batch_index)
 {
     // random pickup one position
@@ -141,7 +179,6 @@ void DataLoaderThread::setAlphaZeroTrainingData(int batch_index)
     const EnvironmentLoader& env_loader = getSharedData()->replay_buffer_.env_loaders_[env_id];
     Rotation rotation = static_cast<Rotation>(Random::randInt() % static_cast<int>(Rotation::kRotateSize));
     float loss_scale = getSharedData()->replay_buffer_.getLossScale(p);
-    std::vector<float> features = env_loader.getFeatures(pos, rotation);
     std::vector<float> policy = env_loader.getPolicy(pos, rotation);
     std::vector<float> value = env_loader.getValue(pos);
 
@@ -149,7 +186,7 @@ void DataLoaderThread::setAlphaZeroTrainingData(int batch_index)
     getSharedData()->getDataPtr()->loss_scale_[batch_index] = loss_scale;
     getSharedData()->getDataPtr()->sampled_index_[2 * batch_index] = p.first;
     getSharedData()->getDataPtr()->sampled_index_[2 * batch_index + 1] = p.second;
-    std::copy(features.begin(), features.end(), getSharedData()->getDataPtr()->features_ + features.size() * batch_index);
+    env_loader.getFeaturesInto(pos, getSharedData()->getDataPtr()->features_ + getSharedData()->feature_size_ * batch_index, rotation);
     std::copy(policy.begin(), policy.end(), getSharedData()->getDataPtr()->policy_ + policy.size() * batch_index);
     std::copy(value.begin(), value.end(), getSharedData()->getDataPtr()->value_ + value.size() * batch_index);
 }
@@ -164,7 +201,6 @@ void DataLoaderThread::setMuZeroTrainingData(int batch_index)
     const EnvironmentLoader& env_loader = getSharedData()->replay_buffer_.env_loaders_[env_id];
     Rotation rotation = static_cast<Rotation>(Random::randInt() % static_cast<int>(Rotation::kRotateSize));
     float loss_scale = getSharedData()->replay_buffer_.getLossScale(p);
-    std::vector<float> features = env_loader.getFeatures(pos, rotation);
     std::vector<float> action_features, policy, value, reward, tmp;
     for (int step = 0; step <= config::learner_muzero_unrolling_step; ++step) {
         // action features
@@ -192,7 +228,7 @@ void DataLoaderThread::setMuZeroTrainingData(int batch_index)
     getSharedData()->getDataPtr()->loss_scale_[batch_index] = loss_scale;
     getSharedData()->getDataPtr()->sampled_index_[2 * batch_index] = p.first;
     getSharedData()->getDataPtr()->sampled_index_[2 * batch_index + 1] = p.second;
-    std::copy(features.begin(), features.end(), getSharedData()->getDataPtr()->features_ + features.size() * batch_index);
+    env_loader.getFeaturesInto(pos, getSharedData()->getDataPtr()->features_ + getSharedData()->feature_size_ * batch_index, rotation);
     std::copy(action_features.begin(), action_features.end(), getSharedData()->getDataPtr()->action_features_ + action_features.size() * batch_index);
     std::copy(policy.begin(), policy.end(), getSharedData()->getDataPtr()->policy_ + policy.size() * batch_index);
     std::copy(value.begin(), value.end(), getSharedData()->getDataPtr()->value_ + value.size() * batch_index);
@@ -211,6 +247,9 @@ void DataLoader::initialize()
 {
     createSlaveThreads(config::learner_num_thread);
     getSharedData()->createDataPtr();
+
+    Environment env;
+    getSharedData()->feature_size_ = env.getNumInputChannels() * env.getInputChannelHeight() * env.getInputChannelWidth();
 }
 
 void DataLoader::loadDataFromFile(const std::string& file_name)
@@ -220,7 +259,6 @@ void DataLoader::loadDataFromFile(const std::string& file_name)
 
     for (auto& t : slave_threads_) { t->start(); }
     for (auto& t : slave_threads_) { t->finish(); }
-    getSharedData()->replay_buffer_.game_priority_sum_ = std::accumulate(getSharedData()->replay_buffer_.game_priorities_.begin(), getSharedData()->replay_buffer_.game_priorities_.end(), 0.0f);
 }
 
 void DataLoader::sampleData()
@@ -232,24 +270,26 @@ void DataLoader::sampleData()
 
 void DataLoader::updatePriority(int* sampled_index, float* batch_values)
 {
-    // TODO: use multiple threads
+    // group batch indices by game so that each game is updated by only one thread
+    std::unordered_map<int, int> env_group_index;
+    std::vector<std::vector<int>>& groups = getSharedData()->priority_update_groups_;
+    groups.clear();
     for (int batch_index = 0; batch_index < config::learner_batch_size; ++batch_index) {
         int env_id = sampled_index[2 * batch_index];
-        int pos_id = sampled_index[2 * batch_index + 1];
-
-        EnvironmentLoader& env_loader = getSharedData()->replay_buffer_.env_loaders_[env_id];
-        for (int step = 0; step <= config::learner_muzero_unrolling_step; ++step) {
-            float new_value = utils::invertValue(batch_values[step * config::learner_batch_size + batch_index]);
-            env_loader.setActionPairInfo(pos_id + step, "V", std::to_string(new_value));
+        auto it = env_group_index.find(env_id);
+        if (it == env_group_index.end()) {
+            it = env_group_index.insert({env_id, groups.size()}).first;
+            groups.emplace_back();
         }
-        getSharedData()->replay_buffer_.position_priorities_[env_id][pos_id] = std::pow(env_loader.getPriority(pos_id), config::learner_per_alpha);
+        groups[it->second].push_back(batch_index);
     }
 
-    // recalculate priority to correct floating number error (TODO: speedup this)
-    for (size_t i = 0; i < getSharedData()->replay_buffer_.game_priorities_.size(); ++i) {
-        getSharedData()->replay_buffer_.game_priorities_[i] = std::accumulate(getSharedData()->replay_buffer_.position_priorities_[i].begin(), getSharedData()->replay_buffer_.position_priorities_[i].end(), 0.0f);
-    }
-    getSharedData()->replay_buffer_.game_priority_sum_ = std::accumulate(getSharedData()->replay_buffer_.game_priorities_.begin(), getSharedData()->replay_buffer_.game_priorities_.end(), 0.0f);
+    getSharedData()->priority_update_group_index_ = 0;
+    getSharedData()->priority_update_sampled_index_ = sampled_index;
+    getSharedData()->priority_update_batch_values_ = batch_values;
+    for (auto& t : slave_threads_) { t->start(); }
+    for (auto& t : slave_threads_) { t->finish(); }
+    groups.clear();
 }
 
 } // namespace minizero::learner
@@ -2,6 +2,7 @@
 
 #include "environment.h"
 #include "paralleler.h"
+#include "sum_tree.h"
 #include <deque>
 #include <memory>
 #include <mutex>
@@ -35,16 +36,18 @@ class ReplayBuffer {
 public:
     ReplayBuffer();
 
+    // games are stored in a ring buffer, the oldest game is overwritten when the buffer is full
     std::mutex mutex_;
     int num_data_;
-    float game_priority_sum_;
-    std::deque<float> game_priorities_;
-    std::deque<std::deque<float>> position_priorities_;
-    std::deque<EnvironmentLoader> env_loaders_;
+    int next_env_id_;
+    utils::SumTree game_priorities_;
+    std::vector<utils::SumTree> position_priorities_;
+    std::vector<EnvironmentLoader> env_loaders_;
 
     void addData(const EnvironmentLoader& env_loader);
+    void updatePositionPriority(int env_id, int pos, float priority);
+    void updateGamePriority(int env_id);
     std::pair<int, int> sampleEnvAndPos();
-    int sampleIndex(const std::deque<float>& weight);
     float getLossScale(const std::pair<int, int>& p);
 };
 
@@ -52,11 +55,17 @@ class DataLoaderSharedData : public utils::BaseSharedData {
 public:
     std::string getNextEnvString();
     int getNextBatchIndex();
+    int getNextPriorityUpdateGroupIndex();
 
     virtual void createDataPtr() { data_ptr_ = std::make_shared<BatchDataPtr>(); }
     inline std::shared_ptr<BatchDataPtr> getDataPtr() { return std::static_pointer_cast<BatchDataPtr>(data_ptr_); }
 
     int batch_index_;
+    int feature_size_;
+    int priority_update_group_index_;
+    int* priority_update_sampled_index_;
+    float* priority_update_batch_values_;
+    std::vector<std::vector<int>> priority_update_groups_; // batch indices grouped by env id
     ReplayBuffer replay_buffer_;
     std::mutex mutex_;
     std::deque<std::string> env_strings_;
@@ -75,6 +84,7 @@ public:
 protected:
     virtual bool addEnvironmentLoader();
     virtual bool sampleData();
+    virtual bool updatePriority();
 
     virtual void setAlphaZeroTrainingData(int batch_index);
     virtual void setMuZeroTrainingData(int batch_index);
@@ -36,6 +36,7 @@ PYBIND11_MODULE(minizero_py, m)
     m.def("use_gumbel", []() { return config::actor_use_gumbel; });
     m.def("get_zero_replay_buffer", []() { return config::zero_replay_buffer; });
     m.def("use_per", []() { return config::learner_use_per; });
+    m.def("use_cpu_quantize_int8", []() { return config::nn_cpu_quantize_int8; });
     m.def("get_training_step", []() { return config::learner_training_step; });
     m.def("get_training_display_step", []() { return config::learner_training_display_step; });
     m.def("get_batch_size", []() { return config::learner_batch_size; });
@@ -1,5 +1,6 @@
 #!/usr/bin/env python
 
+import copy
 import sys
 import time
 import torch
@@ -125,6 +126,11 @@ class Model:
                     'scheduler': self.scheduler.state_dict()}
         torch.save(snapshot, f"{training_dir}/model/weight_iter_{self.training_step}.pkl")
         torch.jit.script(self.network.module).save(f"{training_dir}/model/weight_iter_{self.training_step}.pt")
+        if py.use_cpu_quantize_int8():
+            # the model for CPU actors, only linear layers support dynamic quantization
+            cpu_network = copy.deepcopy(self.network.module).to('cpu').eval()
+            quantized_network = torch.ao.quantization.quantize_dynamic(cpu_network, {nn.Linear}, dtype=torch.qint8)
+            torch.jit.script(quantized_network).save(f"{training_dir}/model/weight_iter_{self.training_step}_int8.pt")
 
 
 def calculate_loss(network_output, label_policy, label_value, label_reward, loss_scale):
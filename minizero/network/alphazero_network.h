@@ -1,11 +1,13 @@
 #pragma once
 
+#include "evaluation_cache.h"
 #include "network.h"
 #include "utils.h"
 #include <algorithm>
 #include <memory>
 #include <mutex>
 #include <string>
+#include <utility>
 #include <vector>
 
 namespace minizero::network {
@@ -13,21 +15,33 @@ namespace minizero::network {
 class AlphaZeroNetworkOutput : public NetworkOutput {
 public:
     float value_;
-    std::vector<float> policy_;
-    std::vector<float> policy_logits_;
+    OutputSpan policy_;
+    OutputSpan policy_logits_;
 
-    AlphaZeroNetworkOutput(int policy_size)
+    AlphaZeroNetworkOutput() { value_ = 0.0f; }
+
+    std::shared_ptr<NetworkOutput> clone() const override
     {
-        value_ = 0.0f;
-        policy_.resize(policy_size, 0.0f);
-        policy_logits_.resize(policy_size, 0.0f);
+        auto output = std::make_shared<AlphaZeroNetworkOutput>();
+        output->value_ = value_;
+        output->storage_.reserve(policy_.size() + policy_logits_.size());
+        output->storage_.insert(output->storage_.end(), policy_.begin(), policy_.end());
+        output->storage_.insert(output->storage_.end(), policy_logits_.begin(), policy_logits_.end());
+        output->policy_ = OutputSpan(output->storage_.data(), policy_.size());
+        output->policy_logits_ = OutputSpan(output->storage_.data() + policy_.size(), policy_logits_.size());
+        return output;
     }
+
+protected:
+    std::vector<float> storage_; // the data of a cloned output, empty for outputs referring to a batch
 };
 
 class AlphaZeroNetwork : public Network {
 public:
-    AlphaZeroNetwork()
+    AlphaZeroNetwork(int max_batch_size = kDefaultMaxBatchSize)
+        : max_batch_size_(max_batch_size)
     {
+        assert(max_batch_size_ > 0);
         clear();
     }
 
@@ -35,89 +49,109 @@ public:
     {
         assert(batch_size_ == 0); // should avoid loading model when batch size is not 0
         Network::loadModel(nn_file_name, gpu_id);
+        tensor_input_ = allocateHostBuffer({max_batch_size_, getNumInputChannels(), getInputChannelHeight(), getInputChannelWidth()});
+        tensor_output_ = (gpu_id == -1 ? torch::Tensor() : allocateHostBuffer({max_batch_size_ * (2 * getActionSize() + getDiscreteValueSize())}));
+        evaluation_cache_.clear(); // cached outputs belong to the previous model
         clear();
     }
 
+    void swapModel(Network& network) override
+    {
+        // the input buffer follows the model shape and is swapped as well, so no batch can be pending
+        AlphaZeroNetwork& alphazero_network = static_cast<AlphaZeroNetwork&>(network);
+        assert(batch_size_ == 0 && alphazero_network.batch_size_ == 0 && max_batch_size_ == alphazero_network.max_batch_size_);
+        Network::swapModel(network);
+        std::swap(tensor_input_, alphazero_network.tensor_input_);
+        evaluation_cache_.clear(); // cached outputs belong to the previous model
+    }
+
     std::string toString() const override
     {
         std::ostringstream oss;
         oss << Network::toString();
+        oss << "Max batch size: " << max_batch_size_ << std::endl;
         return oss.str();
     }
 
-    int pushBack(std::vector<float> features)
+    // reserve one slot of the batch, the caller writes the input features into the returned buffer before forward()
+    std::pair<int, float*> allocateInput()
     {
-        assert(static_cast<int>(features.size()) == getNumInputChannels() * getInputChannelHeight() * getInputChannelWidth());
-        assert(batch_size_ < kReserved_batch_size);
-
         int index;
         {
             std::lock_guard<std::mutex> lock(mutex_);
+            assert(batch_size_ < max_batch_size_);
             index = batch_size_++;
-            tensor_input_.resize(batch_size_);
         }
-        tensor_input_[index] = torch::from_blob(features.data(), {1, getNumInputChannels(), getInputChannelHeight(), getInputChannelWidth()}).clone();
-        return index;
+        return {index, tensor_input_.data_ptr<float>() + index * getInputSize()};
     }
 
-    std::vector<std::shared_ptr<NetworkOutput>> forward()
+    int pushBack(const std::vector<float>& features)
+    {
+        assert(static_cast<int>(features.size()) == getInputSize());
+
+        std::pair<int, float*> input = allocateInput();
+        std::copy(features.begin(), features.end(), input.second);
+        return input.first;
+    }
+
+    virtual std::vector<std::shared_ptr<NetworkOutput>> forward()
     {
         assert(batch_size_ > 0);
-        auto forward_result = network_.forward(std::vector<torch::jit::IValue>{torch::cat(tensor_input_).to(getDevice())}).toGenericDict();
+        setCPUInferenceThreads();
+        auto forward_result = network_.forward(std::vector<torch::jit::IValue>{copyToDevice(tensor_input_.narrow(0, 0, batch_size_))}).toGenericDict();
 
-        auto policy_output = forward_result.at("policy").toTensor().to(at::kCPU);
-        auto policy_logits_output = forward_result.at("policy_logit").toTensor().to(at::kCPU);
-        auto value_output = forward_result.at("value").toTensor().to(at::kCPU);
+        auto outputs = transferOutputsToHost({forward_result.at("policy").toTensor(), forward_result.at("policy_logit").toTensor(), forward_result.at("value").toTensor()});
+        auto& policy_output = outputs[0];
+        auto& policy_logits_output = outputs[1];
+        auto& value_output = outputs[2];
         assert(policy_output.numel() == batch_size_ * getActionSize());
         assert(policy_logits_output.numel() == batch_size_ * getActionSize());
         assert(value_output.numel() == batch_size_ * getDiscreteValueSize());
 
         const int policy_size = getActionSize();
-        std::vector<std::shared_ptr<NetworkOutput>> network_outputs;
+        auto batch = std::make_shared<NetworkOutputBatch<AlphaZeroNetworkOutput>>();
+        batch->outputs_.resize(batch_size_);
         for (int i = 0; i < batch_size_; ++i) {
-            network_outputs.emplace_back(std::make_shared<AlphaZeroNetworkOutput>(policy_size));
-            auto alphazero_network_output = std::static_pointer_cast<AlphaZeroNetworkOutput>(network_outputs.back());
+            AlphaZeroNetworkOutput& alphazero_network_output = batch->outputs_[i];
 
             // policy & policy logits
-            std::copy(policy_output.data_ptr<float>() + i * policy_size,
-                      policy_output.data_ptr<float>() + (i + 1) * policy_size,
-                      alphazero_network_output->policy_.begin());
-            std::copy(policy_logits_output.data_ptr<float>() + i * policy_size,
-                      policy_logits_output.data_ptr<float>() + (i + 1) * policy_size,
-                      alphazero_network_output->policy_logits_.begin());
+            alphazero_network_output.policy_ = OutputSpan(policy_output.data_ptr<float>() + i * policy_size, policy_size);
+            alphazero_network_output.policy_logits_ = OutputSpan(policy_logits_output.data_ptr<float>() + i * policy_size, policy_size);
 
             // value
             if (getDiscreteValueSize() == 1) {
-                alphazero_network_output->value_ = value_output[i].item<float>();
+                alphazero_network_output.value_ = value_output.data_ptr<float>()[i];
             } else {
                 int start_value = -getDiscreteValueSize() / 2;
-                alphazero_network_output->value_ = std::accumulate(value_output.data_ptr<float>() + i * getDiscreteValueSize(),
-                                                                   value_output.data_ptr<float>() + (i + 1) * getDiscreteValueSize(),
-                                                                   0.0f,
-                                                                   [&start_value](const float& sum, const float& value) { return sum + value * start_value++; });
-                alphazero_network_output->value_ = utils::invertValue(alphazero_network_output->value_);
+                alphazero_network_output.value_ = std::accumulate(value_output.data_ptr<float>() + i * getDiscreteValueSize(),
+                                                                  value_output.data_ptr<float>() + (i + 1) * getDiscreteValueSize(),
+                                                                  0.0f,
+                                                                  [&start_value](const float& sum, const float& value) { return sum + value * start_value++; });
+                alphazero_network_output.value_ = utils::invertValue(alphazero_network_output.value_);
             }
         }
+        batch->tensors_ = std::move(outputs);
+        std::vector<std::shared_ptr<NetworkOutput>> network_outputs = NetworkOutputBatch<AlphaZeroNetworkOutput>::share(batch);
 
         clear();
         return network_outputs;
     }
 
     inline int getBatchSize() const { return batch_size_; }
+    inline int getMaxBatchSize() const { return max_batch_size_; }
+    inline EvaluationCache& getEvaluationCache() { return evaluation_cache_; }
+    inline int getInputSize() const { return getNumInputChannels() * getInputChannelHeight() * getInputChannelWidth(); }
+
+    static constexpr int kDefaultMaxBatchSize = 4096;
 
 protected:
-    inline void clear()
-    {
-        batch_size_ = 0;
-        tensor_input_.clear();
-        tensor_input_.reserve(kReserved_batch_size);
-    }
+    inline void clear() { batch_size_ = 0; }
 
     int batch_size_;
+    int max_batch_size_;
     std::mutex mutex_;
-    std::vector<torch::Tensor> tensor_input_;
-
-    const int kReserved_batch_size = 4096;
+    torch::Tensor tensor_input_;
+    EvaluationCache evaluation_cache_;
 };
 
 } // namespace minizero::network
@@ -3,12 +3,13 @@
 #include "alphazero_network.h"
 #include "muzero_network.h"
 #include "network.h"
+#include "nn_client_network.h"
 #include <memory>
 #include <string>
 
 namespace minizero::network {
 
-inline std::shared_ptr<Network> createNetwork(const std::string& nn_file_name, const int gpu_id)
+inline std::shared_ptr<Network> createNetwork(const std::string& nn_file_name, const int gpu_id, const int max_batch_size, const CPUInferenceOptions& cpu_inference_options = CPUInferenceOptions())
 {
     // TODO: how to speed up?
     Network base_network;
@@ -16,10 +17,12 @@ inline std::shared_ptr<Network> createNetwork(const std::string& nn_file_name, c
 
     std::shared_ptr<Network> network;
     if (base_network.getNetworkTypeName() == "alphazero") {
-        network = std::make_shared<AlphaZeroNetwork>();
+        network = std::make_shared<AlphaZeroNetwork>(max_batch_size);
+        network->setCPUInferenceOptions(cpu_inference_options);
         std::dynamic_pointer_cast<AlphaZeroNetwork>(network)->loadModel(nn_file_name, gpu_id);
     } else if (base_network.getNetworkTypeName() == "muzero" || base_network.getNetworkTypeName() == "muzero_atari") {
-        network = std::make_shared<MuZeroNetwork>();
+        network = std::make_shared<MuZeroNetwork>(max_batch_size);
+        network->setCPUInferenceOptions(cpu_inference_options);
         std::dynamic_pointer_cast<MuZeroNetwork>(network)->loadModel(nn_file_name, gpu_id);
     } else {
         // should not be here
@@ -29,4 +32,12 @@ inline std::shared_ptr<Network> createNetwork(const std::string& nn_file_name, c
     return network;
 }
 
+// a network served by the nn_server of the given name, which loads nn_file_name unless it is empty
+inline std::shared_ptr<Network> createNNClientNetwork(const std::string& nn_server_name, const std::string& nn_file_name, const int max_batch_size)
+{
+    std::shared_ptr<NNClientNetwork> network = std::make_shared<NNClientNetwork>(nn_server_name, max_batch_size);
+    network->loadModel(nn_file_name, -1);
+    return network;
+}
+
 } // namespace minizero::network
@@ -0,0 +1,164 @@
+#pragma once
+
+#include "network.h"
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+namespace minizero::network {
+
+// the key of an evaluation cache entry: the hash locating the entry, and an independent hash verifying it
+// a position is only served from the cache if both hashes match, so a collision of one hash does not return the output of another position
+class EvaluationCacheKey {
+public:
+    uint64_t hash_;
+    uint64_t check_;
+};
+
+// a lock-striped cache of network outputs keyed by the hash of the (rotated) input features
+// each shard is guarded by its own mutex and evicts entries with the clock algorithm
+class EvaluationCache {
+public:
+    EvaluationCache() { reset(0); }
+
+    inline void reset(size_t capacity)
+    {
+        capacity_ = capacity;
+        size_t shard_capacity = (capacity + kNumShards - 1) / kNumShards;
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex_);
+            shard.capacity_ = shard_capacity;
+            shard.clear();
+        }
+        num_lookups_ = num_hits_ = 0;
+    }
+
+    inline void clear()
+    {
+        for (auto& shard : shards_) {
+            std::lock_guard<std::mutex> lock(shard.mutex_);
+            shard.clear();
+        }
+    }
+
+    inline std::shared_ptr<NetworkOutput> lookup(const EvaluationCacheKey& key)
+    {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        ++num_lookups_;
+        auto it = shard.index_.find(key.hash_);
+        if (it == shard.index_.end()) { return nullptr; }
+        Entry& entry = shard.entries_[it->second];
+        if (entry.key_.check_ != key.check_) { return nullptr; }
+        ++num_hits_;
+        entry.referenced_ = true;
+        return entry.output_;
+    }
+
+    inline void insert(const EvaluationCacheKey& key, const std::shared_ptr<NetworkOutput>& output)
+    {
+        Shard& shard = getShard(key);
+        std::lock_guard<std::mutex> lock(shard.mutex_);
+        auto it = shard.index_.find(key.hash_);
+        if (it != shard.index_.end()) {
+            // the entry is replaced if it belongs to another position of the same hash
+            shard.entries_[it->second].key_ = key;
+            shard.entries_[it->second].output_ = output;
+            return;
+        }
+
+        size_t slot = shard.entries_.size();
+        if (slot < shard.capacity_) {
+            shard.entries_.push_back({key, output, false});
+        } else {
+            // give referenced entries a second chance, then evict the first unreferenced one
+            while (shard.entries_[shard.clock_hand_].referenced_) {
+                shard.entries_[shard.clock_hand_].referenced_ = false;
+                shard.clock_hand_ = (shard.clock_hand_ + 1) % shard.capacity_;
+            }
+            slot = shard.clock_hand_;
+            shard.clock_hand_ = (shard.clock_hand_ + 1) % shard.capacity_;
+            shard.index_.erase(shard.entries_[slot].key_.hash_);
+            shard.entries_[slot] = {key, output, false};
+        }
+        shard.index_[key.hash_] = slot;
+    }
+
+    inline bool isEnabled() const { return capacity_ > 0; }
+    inline size_t getCapacity() const { return capacity_; }
+    inline uint64_t getNumLookups() const { return num_lookups_; }
+    inline uint64_t getNumHits() const { return num_hits_; }
+    inline float getHitRate() const { return (num_lookups_ > 0 ? static_cast<float>(num_hits_) / num_lookups_ : 0.0f); }
+
+    static inline EvaluationCacheKey hashFeatures(const float* features, int size)
+    {
+        // most features are 0 or 1, whose bit patterns differ in a few bits only, so every word is mixed by a 64-bit finalizer
+        // the two hashes chain the words with different seeds and combinations, so that they collide independently
+        EvaluationCacheKey key{0x9e3779b97f4a7c15ULL, 0xc2b2ae3d27d4eb4fULL};
+        int i = 0;
+        for (; i + 1 < size; i += 2) {
+            uint64_t word;
+            std::memcpy(&word, features + i, sizeof(word));
+            key.hash_ = fmix64(key.hash_ ^ word);
+            key.check_ = fmix64(key.check_ + word * 0x165667b19e3779f9ULL + i);
+        }
+        if (i < size) {
+            uint32_t word;
+            std::memcpy(&word, features + i, sizeof(word));
+            key.hash_ = fmix64(key.hash_ ^ word);
+            key.check_ = fmix64(key.check_ + word * 0x165667b19e3779f9ULL + i);
+        }
+        key.check_ = fmix64(key.check_ + size);
+        return key;
+    }
+
+private:
+    class Entry {
+    public:
+        EvaluationCacheKey key_;
+        std::shared_ptr<NetworkOutput> output_;
+        bool referenced_;
+    };
+
+    class Shard {
+    public:
+        inline void clear()
+        {
+            clock_hand_ = 0;
+            entries_.clear();
+            index_.clear();
+        }
+
+        std::mutex mutex_;
+        size_t capacity_;
+        size_t clock_hand_;
+        std::vector<Entry> entries_;
+        std::unordered_map<uint64_t, size_t> index_;
+    };
+
+    inline Shard& getShard(const EvaluationCacheKey& key) { return shards_[(key.hash_ >> 32) % kNumShards]; }
+
+    // the finalizer of murmurhash3, every input bit affects every output bit
+    static inline uint64_t fmix64(uint64_t k)
+    {
+        k ^= k >> 33;
+        k *= 0xff51afd7ed558ccdULL;
+        k ^= k >> 33;
+        k *= 0xc4ceb9fe1a85ec53ULL;
+        k ^= k >> 33;
+        return k;
+    }
+
+    static constexpr int kNumShards = 64;
+
+    size_t capacity_;
+    Shard shards_[kNumShards];
+    std::atomic<uint64_t> num_lookups_;
+    std::atomic<uint64_t> num_hits_;
+};
+
+} // namespace minizero::network
@@ -0,0 +1,199 @@
+#include "inference_scheduler.h"
+#include "alphazero_network.h"
+#include "muzero_network.h"
+#include <algorithm>
+#include <cassert>
+#include <exception>
+#include <sstream>
+#include <utility>
+
+namespace minizero::network {
+
+InferenceScheduler::InferenceScheduler(const std::vector<std::shared_ptr<Network>>& replicas, int max_batch_size, int deadline_us)
+    : max_batch_size_(max_batch_size),
+      deadline_(deadline_us),
+      stop_(false),
+      replicas_(replicas)
+{
+    assert(!replicas_.empty() && max_batch_size_ > 0 && deadline_us >= 0);
+    resetStatistics();
+    for (size_t replica_id = 0; replica_id < replicas_.size(); ++replica_id) { threads_.emplace_back(&InferenceScheduler::runReplica, this, replica_id); }
+}
+
+InferenceScheduler::~InferenceScheduler()
+{
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& thread : threads_) { thread.join(); }
+}
+
+std::future<std::shared_ptr<NetworkOutput>> InferenceScheduler::submit(RequestType type, std::vector<float> features, std::vector<float> actions /* = {} */)
+{
+    Request request;
+    request.features_ = std::move(features);
+    request.actions_ = std::move(actions);
+    request.submit_time_ = Clock::now();
+    std::future<std::shared_ptr<NetworkOutput>> future = request.promise_.get_future();
+    {
+        std::lock_guard<std::mutex> lock(mutex_);
+        assert(!stop_);
+        queues_[static_cast<int>(type)].push_back(std::move(request));
+        ++num_requests_;
+        max_queue_depth_ = std::max(max_queue_depth_, getQueueDepth());
+    }
+    cv_.notify_one();
+    return future;
+}
+
+void InferenceScheduler::resetStatistics()
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    num_requests_ = num_batches_ = 0;
+    max_queue_depth_ = 0;
+    batch_size_counts_.assign(max_batch_size_ + 1, 0);
+    latencies_us_.assign(kMaxLatencySamples, 0.0f);
+    num_latencies_ = 0;
+}
+
+std::string InferenceScheduler::getStatistics() const
+{
+    std::lock_guard<std::mutex> lock(mutex_);
+    uint64_t num_batched_requests = 0;
+    for (int batch_size = 1; batch_size <= max_batch_size_; ++batch_size) { num_batched_requests += batch_size * batch_size_counts_[batch_size]; }
+    std::ostringstream oss;
+    oss << "requests: " << num_requests_
+        << ", batches: " << num_batches_
+        << ", average batch size: " << (num_batches_ > 0 ? static_cast<float>(num_batched_requests) / num_batches_ : 0.0f)
+        << ", queue depth: " << getQueueDepth() << " (max " << max_queue_depth_ << ")";
+
+    // batch sizes in power-of-two buckets, e.g., 1, 2-3, 4-7, ...
+    oss << ", batch sizes:";
+    for (int low = 1; low <= max_batch_size_; low *= 2) {
+        int high = std::min(low * 2 - 1, max_batch_size_);
+        uint64_t count = 0;
+        for (int batch_size = low; batch_size <= high; ++batch_size) { count += batch_size_counts_[batch_size]; }
+        if (count == 0) { continue; }
+        oss << " " << low;
+        if (high > low) { oss << "-" << high; }
+        oss << ":" << count;
+    }
+
+    std::vector<float> latencies(latencies_us_.begin(), latencies_us_.begin() + std::min<uint64_t>(num_latencies_, kMaxLatencySamples));
+    if (!latencies.empty()) {
+        oss << ", latency";
+        for (float percentile : {0.5f, 0.99f}) {
+            auto nth = latencies.begin() + static_cast<size_t>(percentile * (latencies.size() - 1));
+            std::nth_element(latencies.begin(), nth, latencies.end());
+            oss << " p" << static_cast<int>(percentile * 100) << ": " << *nth / 1000.0f << " ms";
+        }
+    }
+    return oss.str();
+}
+
+void InferenceScheduler::runReplica(int replica_id)
+{
+    Network& network = *replicas_[replica_id];
+    std::vector<Request> batch;
+    while (true) {
+        RequestType type;
+        {
+            // wait until the oldest queue has a full batch or its oldest request reaches the deadline
+            std::unique_lock<std::mutex> lock(mutex_);
+            int queue_id = -1;
+            while (true) {
+                queue_id = getOldestQueue();
+                if (queue_id == -1) {
+                    if (stop_) { return; }
+                    cv_.wait(lock);
+                    continue;
+                }
+                if (stop_ || static_cast<int>(queues_[queue_id].size()) >= max_batch_size_) { break; }
+                Clock::time_point deadline = queues_[queue_id].front().submit_time_ + deadline_;
+                if (Clock::now() >= deadline) { break; }
+                cv_.wait_until(lock, deadline);
+            }
+
+            type = static_cast<RequestType>(queue_id);
+            std::deque<Request>& queue = queues_[queue_id];
+            int batch_size = std::min(static_cast<int>(queue.size()), max_batch_size_);
+            for (int i = 0; i < batch_size; ++i) {
+                batch.push_back(std::move(queue.front()));
+                queue.pop_front();
+            }
+            ++num_batches_;
+            ++batch_size_counts_[batch_size];
+        }
+        cv_.notify_one(); // the remaining requests may be taken by another replica
+
+        std::vector<std::shared_ptr<NetworkOutput>> outputs;
+        try {
+            outputs = forward(network, type, batch);
+        } catch (...) {
+            // pass the failure to every waiting caller instead of leaving their futures unresolved
+            for (auto& request : batch) { request.promise_.set_exception(std::current_exception()); }
+            batch.clear();
+            continue;
+        }
+        assert(outputs.size() == batch.size());
+        Clock::time_point finish_time = Clock::now();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            for (const auto& request : batch) { latencies_us_[num_latencies_++ % kMaxLatencySamples] = std::chrono::duration_cast<std::chrono::microseconds>(finish_time - request.submit_time_).count(); }
+        }
+        for (size_t i = 0; i < batch.size(); ++i) { batch[i].promise_.set_value(outputs[i]); }
+        batch.clear();
+    }
+}
+
+std::vector<std::shared_ptr<NetworkOutput>> InferenceScheduler::forward(Network& network, RequestType type, std::vector<Request>& batch)
+{
+    // the batch indices of the network follow the order of the requests since only this replica thread writes its inputs
+    if (type == RequestType::kAlphaZero) {
+        assert(network.getNetworkTypeName() == "alphazero");
+        AlphaZeroNetwork& alphazero_network = static_cast<AlphaZeroNetwork&>(network);
+        for (const auto& request : batch) {
+            assert(static_cast<int>(request.features_.size()) == alphazero_network.getInputSize());
+            std::copy(request.features_.begin(), request.features_.end(), alphazero_network.allocateInput().second);
+        }
+        return alphazero_network.forward();
+    }
+
+    assert(network.getNetworkTypeName() == "muzero" || network.getNetworkTypeName() == "muzero_atari");
+    MuZeroNetwork& muzero_network = static_cast<MuZeroNetwork&>(network);
+    if (type == RequestType::kMuZeroInitial) {
+        for (const auto& request : batch) {
+            assert(static_cast<int>(request.features_.size()) == muzero_network.getInputSize());
+            std::copy(request.features_.begin(), request.features_.end(), muzero_network.allocateInitialInput().second);
+        }
+        return muzero_network.initialInference();
+    }
+
+    assert(type == RequestType::kMuZeroRecurrent);
+    for (const auto& request : batch) {
+        assert(static_cast<int>(request.features_.size()) == muzero_network.getHiddenStateSize());
+        std::copy(request.features_.begin(), request.features_.end(), muzero_network.allocateRecurrentInput(request.actions_).second);
+    }
+    return muzero_network.recurrentInference();
+}
+
+int InferenceScheduler::getOldestQueue() const
+{
+    int oldest_queue_id = -1;
+    for (int queue_id = 0; queue_id < static_cast<int>(RequestType::kSize); ++queue_id) {
+        if (queues_[queue_id].empty()) { continue; }
+        if (oldest_queue_id == -1 || queues_[queue_id].front().submit_time_ < queues_[oldest_queue_id].front().submit_time_) { oldest_queue_id = queue_id; }
+    }
+    return oldest_queue_id;
+}
+
+int InferenceScheduler::getQueueDepth() const
+{
+    int queue_depth = 0;
+    for (const auto& queue : queues_) { queue_depth += queue.size(); }
+    return queue_depth;
+}
+
+} // namespace minizero::network
@@ -0,0 +1,77 @@
+#pragma once
+
+#include "network.h"
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace minizero::network {
+
+// an asynchronous front end of networks shared by the threads evaluating positions
+// requests are queued and formed into batches, a batch is run once it reaches the max batch size or its oldest request has waited for the deadline
+// each replica (a network with its own buffers, e.g., one per GPU) is served by its own thread, so replicas run batches concurrently
+class InferenceScheduler {
+public:
+    enum class RequestType {
+        kAlphaZero,
+        kMuZeroInitial,
+        kMuZeroRecurrent,
+        kSize
+    };
+
+    InferenceScheduler(const std::vector<std::shared_ptr<Network>>& replicas, int max_batch_size, int deadline_us);
+    ~InferenceScheduler();
+
+    // the features are the network input, or the hidden state for recurrent inference
+    std::future<std::shared_ptr<NetworkOutput>> submit(RequestType type, std::vector<float> features, std::vector<float> actions = {});
+
+    void resetStatistics();
+    std::string getStatistics() const;
+    inline int getNumReplicas() const { return replicas_.size(); }
+    inline int getMaxBatchSize() const { return max_batch_size_; }
+    inline int getDeadline() const { return deadline_.count(); }
+
+private:
+    typedef std::chrono::steady_clock Clock;
+
+    class Request {
+    public:
+        std::vector<float> features_;
+        std::vector<float> actions_;
+        Clock::time_point submit_time_;
+        std::promise<std::shared_ptr<NetworkOutput>> promise_;
+    };
+
+    void runReplica(int replica_id);
+    std::vector<std::shared_ptr<NetworkOutput>> forward(Network& network, RequestType type, std::vector<Request>& batch);
+    int getOldestQueue() const;
+    int getQueueDepth() const;
+
+    static constexpr int kMaxLatencySamples = 1 << 16;
+
+    int max_batch_size_;
+    std::chrono::microseconds deadline_;
+    bool stop_;
+    std::vector<std::shared_ptr<Network>> replicas_;
+    std::vector<std::thread> threads_;
+    std::deque<Request> queues_[static_cast<int>(RequestType::kSize)];
+    mutable std::mutex mutex_;
+    std::condition_variable cv_;
+
+    // statistics, guarded by mutex_
+    uint64_t num_requests_;
+    uint64_t num_batches_;
+    int max_queue_depth_;
+    std::vector<uint64_t> batch_size_counts_;
+    std::vector<float> latencies_us_; // the latencies of the latest requests in a ring buffer
+    uint64_t num_latencies_;
+};
+
+} // namespace minizero::network
@@ -15,32 +15,50 @@ class MuZeroNetworkOutput : public NetworkOutput {
 public:
     float value_;
     float reward_;
-    std::vector<float> policy_;
-    std::vector<float> policy_logits_;
-    std::vector<float> hidden_state_;
+    OutputSpan policy_;
+    OutputSpan policy_logits_;
+    OutputSpan hidden_state_;
+    int hidden_state_slot_; // the slot in the hidden state pool, -1 if the hidden state is copied into hidden_state_
 
-    MuZeroNetworkOutput(int policy_size, int hidden_state_size)
+    MuZeroNetworkOutput()
     {
         value_ = 0.0f;
         reward_ = 0.0f;
-        policy_.resize(policy_size, 0.0f);
-        policy_logits_.resize(policy_size, 0.0f);
-        hidden_state_.resize(hidden_state_size, 0.0f);
+        hidden_state_slot_ = -1;
     }
+
+    std::shared_ptr<NetworkOutput> clone() const override
+    {
+        auto output = std::make_shared<MuZeroNetworkOutput>();
+        output->value_ = value_;
+        output->reward_ = reward_;
+        output->hidden_state_slot_ = hidden_state_slot_;
+        output->storage_.reserve(policy_.size() + policy_logits_.size() + hidden_state_.size());
+        output->storage_.insert(output->storage_.end(), policy_.begin(), policy_.end());
+        output->storage_.insert(output->storage_.end(), policy_logits_.begin(), policy_logits_.end());
+        output->storage_.insert(output->storage_.end(), hidden_state_.begin(), hidden_state_.end());
+        output->policy_ = OutputSpan(output->storage_.data(), policy_.size());
+        output->policy_logits_ = OutputSpan(output->storage_.data() + policy_.size(), policy_logits_.size());
+        output->hidden_state_ = OutputSpan(output->storage_.data() + policy_.size() + policy_logits_.size(), hidden_state_.size());
+        return output;
+    }
+
+protected:
+    std::vector<float> storage_; // the data of a cloned output, empty for outputs referring to a batch
 };
 
 class MuZeroNetwork : public Network {
 public:
-    MuZeroNetwork()
+    MuZeroNetwork(int max_batch_size = kDefaultMaxBatchSize)
+        : max_batch_size_(max_batch_size)
     {
+        assert(max_batch_size_ > 0);
         num_action_feature_channels_ = -1;
         initial_input_batch_size_ = recurrent_input_batch_size_ = 0;
-        initial_tensor_input_.clear();
-        initial_tensor_input_.reserve(kReserved_batch_size);
-        recurrent_tensor_feature_input_.clear();
-        recurrent_tensor_feature_input_.reserve(kReserved_batch_size);
-        recurrent_tensor_action_input_.clear();
-        recurrent_tensor_action_input_.reserve(kReserved_batch_size);
+        num_reserved_hidden_state_slots_ = 0;
+        initial_output_slots_.resize(max_batch_size_, -1);
+        recurrent_input_slots_.resize(max_batch_size_, -1);
+        recurrent_output_slots_.resize(max_batch_size_, -1);
     }
 
     void loadModel(const std::string& nn_file_name, const int gpu_id) override
@@ -51,6 +69,27 @@ public:
         num_action_feature_channels_ = network_.get_method("get_num_action_feature_channels")(dummy).toInt();
         initial_input_batch_size_ = 0;
         recurrent_input_batch_size_ = 0;
+        initial_tensor_input_ = allocateHostBuffer({max_batch_size_, getNumInputChannels(), getInputChannelHeight(), getInputChannelWidth()});
+        recurrent_tensor_feature_input_ = allocateHostBuffer({max_batch_size_, getNumHiddenChannels(), getHiddenChannelHeight(), getHiddenChannelWidth()});
+        recurrent_tensor_action_input_ = allocateHostBuffer({max_batch_size_, getNumActionFeatureChannels(), getHiddenChannelHeight(), getHiddenChannelWidth()});
+        tensor_output_ = (gpu_id == -1 ? torch::Tensor() : allocateHostBuffer({max_batch_size_ * (2 * getActionSize() + 2 * getDiscreteValueSize() + getHiddenStateSize())}));
+
+        // keep the pooled hidden states when reloading the model on the same device, the trees still refer to them
+        if (num_reserved_hidden_state_slots_ > 0 && (!hidden_state_pool_.defined() || hidden_state_pool_.device() != getDevice())) { allocateHiddenStatePool(); }
+    }
+
+    void swapModel(Network& network) override
+    {
+        // the input buffers follow the model shape and are swapped as well, so no batch can be pending
+        // the pooled hidden states are kept, the trees still refer to them
+        MuZeroNetwork& muzero_network = static_cast<MuZeroNetwork&>(network);
+        assert(initial_input_batch_size_ == 0 && recurrent_input_batch_size_ == 0 && max_batch_size_ == muzero_network.max_batch_size_);
+        assert(muzero_network.initial_input_batch_size_ == 0 && muzero_network.recurrent_input_batch_size_ == 0 && getHiddenStateSize() == muzero_network.getHiddenStateSize());
+        Network::swapModel(network);
+        std::swap(num_action_feature_channels_, muzero_network.num_action_feature_channels_);
+        std::swap(initial_tensor_input_, muzero_network.initial_tensor_input_);
+        std::swap(recurrent_tensor_feature_input_, muzero_network.recurrent_tensor_feature_input_);
+        std::swap(recurrent_tensor_action_input_, muzero_network.recurrent_tensor_action_input_);
     }
 
     std::string toString() const override
@@ -58,46 +97,72 @@ public:
         std::ostringstream oss;
         oss << Network::toString();
         oss << "Number of action feature channels: " << num_action_feature_channels_ << std::endl;
+        oss << "Max batch size: " << max_batch_size_ << std::endl;
         return oss.str();
     }
 
-    int pushBackInitialData(std::vector<float> features)
+    // reserve one slot of the initial batch, the caller writes the input features into the returned buffer before initialInference()
+    // the output hidden state is kept in the pool at hidden_state_slot if it is given
+    std::pair<int, float*> allocateInitialInput(int hidden_state_slot = -1)
     {
-        assert(static_cast<int>(features.size()) == getNumInputChannels() * getInputChannelHeight() * getInputChannelWidth());
-
         int index;
         {
             std::lock_guard<std::mutex> lock(initial_mutex_);
+            assert(initial_input_batch_size_ < max_batch_size_);
             index = initial_input_batch_size_++;
-            initial_tensor_input_.resize(initial_input_batch_size_);
         }
-        initial_tensor_input_[index] = torch::from_blob(features.data(), {1, getNumInputChannels(), getInputChannelHeight(), getInputChannelWidth()}).clone();
-        return index;
+        initial_output_slots_[index] = hidden_state_slot;
+        return {index, initial_tensor_input_.data_ptr<float>() + index * getInputSize()};
     }
 
-    int pushBackRecurrentData(std::vector<float> features, std::vector<float> actions)
+    int pushBackInitialData(const std::vector<float>& features)
+    {
+        assert(static_cast<int>(features.size()) == getInputSize());
+
+        std::pair<int, float*> input = allocateInitialInput();
+        std::copy(features.begin(), features.end(), input.second);
+        return input.first;
+    }
+
+    // reserve one slot of the recurrent batch with the given action features, the caller writes the hidden state into the returned buffer before recurrentInference()
+    std::pair<int, float*> allocateRecurrentInput(const std::vector<float>& actions)
     {
-        assert(static_cast<int>(features.size()) == getNumHiddenChannels() * getHiddenChannelHeight() * getHiddenChannelWidth());
         assert(static_cast<int>(actions.size()) == getNumActionFeatureChannels() * getHiddenChannelHeight() * getHiddenChannelWidth());
 
         int index;
         {
             std::lock_guard<std::mutex> lock(recurrent_mutex_);
+            assert(recurrent_input_batch_size_ < max_batch_size_);
             index = recurrent_input_batch_size_++;
-            recurrent_tensor_feature_input_.resize(recurrent_input_batch_size_);
-            recurrent_tensor_action_input_.resize(recurrent_input_batch_size_);
         }
-        recurrent_tensor_feature_input_[index] = torch::from_blob(features.data(), {1, getNumHiddenChannels(), getHiddenChannelHeight(), getHiddenChannelWidth()}).clone();
-        recurrent_tensor_action_input_[index] = torch::from_blob(actions.data(), {1, getNumActionFeatureChannels(), getHiddenChannelHeight(), getHiddenChannelWidth()}).clone();
+        std::copy(actions.begin(), actions.end(), recurrent_tensor_action_input_.data_ptr<float>() + index * actions.size());
+        recurrent_input_slots_[index] = recurrent_output_slots_[index] = -1;
+        return {index, recurrent_tensor_feature_input_.data_ptr<float>() + index * getHiddenStateSize()};
+    }
+
+    // reserve one slot of the recurrent batch whose hidden state is gathered from the pool on the device, and kept there for the output
+    int allocateRecurrentInput(const std::vector<float>& actions, int input_hidden_state_slot, int output_hidden_state_slot)
+    {
+        assert(input_hidden_state_slot >= 0 && output_hidden_state_slot >= 0);
+        int index = allocateRecurrentInput(actions).first;
+        recurrent_input_slots_[index] = input_hidden_state_slot;
+        recurrent_output_slots_[index] = output_hidden_state_slot;
         return index;
     }
 
+    int pushBackRecurrentData(const std::vector<float>& features, const std::vector<float>& actions)
+    {
+        assert(static_cast<int>(features.size()) == getHiddenStateSize());
+
+        std::pair<int, float*> input = allocateRecurrentInput(actions);
+        std::copy(features.begin(), features.end(), input.second);
+        return input.first;
+    }
+
     inline std::vector<std::shared_ptr<NetworkOutput>> initialInference()
     {
         assert(initial_input_batch_size_ > 0);
-        auto outputs = forward("initial_inference", {torch::cat(initial_tensor_input_).to(getDevice())}, initial_input_batch_size_);
-        initial_tensor_input_.clear();
-        initial_tensor_input_.reserve(kReserved_batch_size);
+        auto outputs = forward("initial_inference", {copyToDevice(initial_tensor_input_.narrow(0, 0, initial_input_batch_size_))}, initial_input_batch_size_, initial_output_slots_);
         initial_input_batch_size_ = 0;
         return outputs;
     }
@@ -105,13 +170,16 @@ public:
     inline std::vector<std::shared_ptr<NetworkOutput>> recurrentInference()
     {
         assert(recurrent_input_batch_size_ > 0);
+        torch::Tensor feature_input;
+        if (recurrent_input_slots_[0] >= 0) {
+            // gather the hidden states on the device instead of uploading them from the host
+            feature_input = hidden_state_pool_.index_select(0, torch::from_blob(recurrent_input_slots_.data(), {recurrent_input_batch_size_}, torch::TensorOptions().dtype(torch::kLong)).to(getDevice()));
+        } else {
+            feature_input = copyToDevice(recurrent_tensor_feature_input_.narrow(0, 0, recurrent_input_batch_size_));
+        }
         auto outputs = forward("recurrent_inference",
-                               {{torch::cat(recurrent_tensor_feature_input_).to(getDevice())}, {torch::cat(recurrent_tensor_action_input_).to(getDevice())}},
-                               recurrent_input_batch_size_);
-        recurrent_tensor_feature_input_.clear();
-        recurrent_tensor_feature_input_.reserve(kReserved_batch_size);
-        recurrent_tensor_action_input_.clear();
-        recurrent_tensor_action_input_.reserve(kReserved_batch_size);
+                               {{feature_input}, {copyToDevice(recurrent_tensor_action_input_.narrow(0, 0, recurrent_input_batch_size_))}},
+                               recurrent_input_batch_size_, recurrent_output_slots_);
         recurrent_input_batch_size_ = 0;
         return outputs;
     }
@@ -119,18 +187,70 @@ public:
     inline int getNumActionFeatureChannels() const { return num_action_feature_channels_; }
     inline int getInitialInputBatchSize() const { return initial_input_batch_size_; }
     inline int getRecurrentInputBatchSize() const { return recurrent_input_batch_size_; }
+    inline int getMaxBatchSize() const { return max_batch_size_; }
+    inline int getInputSize() const { return getNumInputChannels() * getInputChannelHeight() * getInputChannelWidth(); }
+    inline int getHiddenStateSize() const { return getNumHiddenChannels() * getHiddenChannelHeight() * getHiddenChannelWidth(); }
+
+    // the hidden state pool is a tensor on the network device shared by all actors of the network, each actor reserves slots for its tree
+    // it must be reserved before inference starts since the pool is reallocated
+    void reserveHiddenStateSlots(int num_slots)
+    {
+        std::lock_guard<std::mutex> lock(hidden_state_pool_mutex_);
+        assert(num_slots > 0);
+        for (int slot = num_reserved_hidden_state_slots_ + num_slots - 1; slot >= num_reserved_hidden_state_slots_; --slot) { free_hidden_state_slots_.push_back(slot); }
+        num_reserved_hidden_state_slots_ += num_slots;
+        if (num_action_feature_channels_ != -1) { allocateHiddenStatePool(); }
+    }
+
+    int acquireHiddenStateSlot()
+    {
+        std::lock_guard<std::mutex> lock(hidden_state_pool_mutex_);
+        assert(!free_hidden_state_slots_.empty());
+        int slot = free_hidden_state_slots_.back();
+        free_hidden_state_slots_.pop_back();
+        return slot;
+    }
+
+    void releaseHiddenStateSlot(int slot)
+    {
+        std::lock_guard<std::mutex> lock(hidden_state_pool_mutex_);
+        assert(slot >= 0 && slot < num_reserved_hidden_state_slots_);
+        free_hidden_state_slots_.push_back(slot);
+    }
+
+    inline bool useHiddenStatePool() const { return num_reserved_hidden_state_slots_ > 0; }
+
+    static constexpr int kDefaultMaxBatchSize = 4096;
 
 protected:
-    std::vector<std::shared_ptr<NetworkOutput>> forward(const std::string& method, const std::vector<torch::jit::IValue>& inputs, int batch_size)
+    void allocateHiddenStatePool()
+    {
+        torch::Tensor old_pool = hidden_state_pool_;
+        hidden_state_pool_ = torch::empty({num_reserved_hidden_state_slots_, getNumHiddenChannels(), getHiddenChannelHeight(), getHiddenChannelWidth()}, torch::TensorOptions().device(getDevice()));
+        if (old_pool.defined()) { hidden_state_pool_.narrow(0, 0, std::min(old_pool.size(0), hidden_state_pool_.size(0))).copy_(old_pool.narrow(0, 0, std::min(old_pool.size(0), hidden_state_pool_.size(0)))); }
+    }
+
+    std::vector<std::shared_ptr<NetworkOutput>> forward(const std::string& method, const std::vector<torch::jit::IValue>& inputs, int batch_size, const std::vector<int64_t>& hidden_state_slots)
     {
         assert(network_.find_method(method));
+        setCPUInferenceThreads();
 
         auto forward_result = network_.get_method(method)(inputs).toGenericDict();
-        auto policy_output = forward_result.at("policy").toTensor().to(at::kCPU);
-        auto policy_logits_output = forward_result.at("policy_logit").toTensor().to(at::kCPU);
-        auto value_output = forward_result.at("value").toTensor().to(at::kCPU);
-        auto reward_output = (forward_result.contains("reward") ? forward_result.at("reward").toTensor().to(at::kCPU) : torch::zeros(0));
-        auto hidden_state_output = forward_result.at("hidden_state").toTensor().to(at::kCPU);
+        // the hidden states either stay on the device in the pool or are copied back to the host, for the whole batch
+        bool keep_hidden_state_in_pool = (hidden_state_slots[0] >= 0);
+        auto hidden_state_output = forward_result.at("hidden_state").toTensor();
+        if (keep_hidden_state_in_pool) { hidden_state_pool_.index_copy_(0, torch::from_blob(const_cast<int64_t*>(hidden_state_slots.data()), {batch_size}, torch::TensorOptions().dtype(torch::kLong)).to(getDevice()), hidden_state_output); }
+
+        auto outputs = transferOutputsToHost({forward_result.at("policy").toTensor(),
+                                              forward_result.at("policy_logit").toTensor(),
+                                              forward_result.at("value").toTensor(),
+                                              (forward_result.contains("reward") ? forward_result.at("reward").toTensor() : torch::zeros(0, torch::TensorOptions().device(getDevice()))),
+                                              (keep_hidden_state_in_pool ? torch::zeros(0, torch::TensorOptions().device(getDevice())) : hidden_state_output)});
+        auto& policy_output = outputs[0];
+        auto& policy_logits_output = outputs[1];
+        auto& value_output = outputs[2];
+        auto& reward_output = outputs[3];
+        if (!keep_hidden_state_in_pool) { hidden_state_output = outputs[4]; }
         assert(policy_output.numel() == batch_size * getActionSize());
         assert(policy_logits_output.numel() == batch_size * getActionSize());
         assert((getNetworkTypeName() != "muzero_atari" && value_output.numel() == batch_size) || (getNetworkTypeName() == "muzero_atari" && value_output.numel() == batch_size * getDiscreteValueSize()));
@@ -139,40 +259,42 @@ protected:
 
         const int policy_size = getActionSize();
         const int hidden_state_size = getNumHiddenChannels() * getHiddenChannelHeight() * getHiddenChannelWidth();
-        std::vector<std::shared_ptr<NetworkOutput>> network_outputs;
+        auto batch = std::make_shared<NetworkOutputBatch<MuZeroNetworkOutput>>();
+        batch->outputs_.resize(batch_size);
         for (int i = 0; i < batch_size; ++i) {
-            network_outputs.emplace_back(std::make_shared<MuZeroNetworkOutput>(policy_size, hidden_state_size));
-            auto muzero_network_output = std::static_pointer_cast<MuZeroNetworkOutput>(network_outputs.back());
-
-            std::copy(policy_output.data_ptr<float>() + i * policy_size,
-                      policy_output.data_ptr<float>() + (i + 1) * policy_size,
-                      muzero_network_output->policy_.begin());
-            std::copy(policy_logits_output.data_ptr<float>() + i * policy_size,
-                      policy_logits_output.data_ptr<float>() + (i + 1) * policy_size,
-                      muzero_network_output->policy_logits_.begin());
-            std::copy(hidden_state_output.data_ptr<float>() + i * hidden_state_size,
-                      hidden_state_output.data_ptr<float>() + (i + 1) * hidden_state_size,
-                      muzero_network_output->hidden_state_.begin());
+            MuZeroNetworkOutput& muzero_network_output = batch->outputs_[i];
+
+            muzero_network_output.policy_ = OutputSpan(policy_output.data_ptr<float>() + i * policy_size, policy_size);
+            muzero_network_output.policy_logits_ = OutputSpan(policy_logits_output.data_ptr<float>() + i * policy_size, policy_size);
+            if (keep_hidden_state_in_pool) {
+                assert(hidden_state_slots[i] >= 0);
+                muzero_network_output.hidden_state_slot_ = hidden_state_slots[i];
+            } else {
+                assert(hidden_state_slots[i] < 0);
+                muzero_network_output.hidden_state_ = OutputSpan(hidden_state_output.data_ptr<float>() + i * hidden_state_size, hidden_state_size);
+            }
 
             if (getNetworkTypeName() == "muzero_atari") {
                 int start_value = -getDiscreteValueSize() / 2;
-                muzero_network_output->value_ = std::accumulate(value_output.data_ptr<float>() + i * getDiscreteValueSize(),
-                                                                value_output.data_ptr<float>() + (i + 1) * getDiscreteValueSize(),
-                                                                0.0f,
-                                                                [&start_value](const float& sum, const float& value) { return sum + value * start_value++; });
-                muzero_network_output->value_ = utils::invertValue(muzero_network_output->value_);
+                muzero_network_output.value_ = std::accumulate(value_output.data_ptr<float>() + i * getDiscreteValueSize(),
+                                                               value_output.data_ptr<float>() + (i + 1) * getDiscreteValueSize(),
+                                                               0.0f,
+                                                               [&start_value](const float& sum, const float& value) { return sum + value * start_value++; });
+                muzero_network_output.value_ = utils::invertValue(muzero_network_output.value_);
                 if (forward_result.contains("reward")) {
                     start_value = -getDiscreteValueSize() / 2;
-                    muzero_network_output->reward_ = std::accumulate(reward_output.data_ptr<float>() + i * getDiscreteValueSize(),
-                                                                     reward_output.data_ptr<float>() + (i + 1) * getDiscreteValueSize(),
-                                                                     0.0f,
-                                                                     [&start_value](const float& sum, const float& value) { return sum + value * start_value++; });
-                    muzero_network_output->reward_ = utils::invertValue(muzero_network_output->reward_);
+                    muzero_network_output.reward_ = std::accumulate(reward_output.data_ptr<float>() + i * getDiscreteValueSize(),
+                                                                    reward_output.data_ptr<float>() + (i + 1) * getDiscreteValueSize(),
+                                                                    0.0f,
+                                                                    [&start_value](const float& sum, const float& value) { return sum + value * start_value++; });
+                    muzero_network_output.reward_ = utils::invertValue(muzero_network_output.reward_);
                 }
             } else {
-                muzero_network_output->value_ = value_output[i].item<float>();
+                muzero_network_output.value_ = value_output.data_ptr<float>()[i];
             }
         }
+        batch->tensors_ = std::move(outputs);
+        std::vector<std::shared_ptr<NetworkOutput>> network_outputs = NetworkOutputBatch<MuZeroNetworkOutput>::share(batch);
 
         return network_outputs;
     }
@@ -180,13 +302,19 @@ protected:
     int num_action_feature_channels_;
     int initial_input_batch_size_;
     int recurrent_input_batch_size_;
+    int max_batch_size_;
+    int num_reserved_hidden_state_slots_;
     std::mutex initial_mutex_;
     std::mutex recurrent_mutex_;
-    std::vector<torch::Tensor> initial_tensor_input_;
-    std::vector<torch::Tensor> recurrent_tensor_feature_input_;
-    std::vector<torch::Tensor> recurrent_tensor_action_input_;
-
-    const int kReserved_batch_size = 4096;
+    std::mutex hidden_state_pool_mutex_;
+    std::vector<int64_t> initial_output_slots_;
+    std::vector<int64_t> recurrent_input_slots_;
+    std::vector<int64_t> recurrent_output_slots_;
+    std::vector<int> free_hidden_state_slots_;
+    torch::Tensor hidden_state_pool_;
+    torch::Tensor initial_tensor_input_;
+    torch::Tensor recurrent_tensor_feature_input_;
+    torch::Tensor recurrent_tensor_action_input_;
 };
 
 } // namespace minizero::network
@@ -1,4 +1,7 @@
 #include "network.h"
+#include <algorithm>
+#include <fstream>
+#include <utility>
 
 namespace minizero::network {
 
@@ -17,8 +20,16 @@ void Network::loadModel(const std::string& nn_file_name, const int gpu_id)
     network_file_name_ = nn_file_name;
 
     // load model weights
+    std::string model_file_name = network_file_name_;
+    if (gpu_id_ == -1 && cpu_inference_options_.quantize_int8_) {
+        if (std::ifstream(getInt8ModelFileName(network_file_name_)).good()) {
+            model_file_name = getInt8ModelFileName(network_file_name_);
+        } else {
+            std::cerr << "[warning] int8 model " << getInt8ModelFileName(network_file_name_) << " is not found, use " << network_file_name_ << " instead" << std::endl;
+        }
+    }
     try {
-        network_ = torch::jit::load(network_file_name_, getDevice());
+        network_ = torch::jit::load(model_file_name, getDevice());
         network_.eval();
     } catch (const c10::Error& e) {
         std::cerr << e.msg() << std::endl;
@@ -39,6 +50,28 @@ void Network::loadModel(const std::string& nn_file_name, const int gpu_id)
     discrete_value_size_ = network_.get_method("get_discrete_value_size")(dummy).toInt();
     game_name_ = network_.get_method("get_game_name")(dummy).toString()->string();
     network_type_name_ = network_.get_method("get_type_name")(dummy).toString()->string();
+
+    if (gpu_id_ == -1 && cpu_inference_options_.optimize_for_inference_) { optimizeForCPUInference(); }
+}
+
+void Network::swapModel(Network& network)
+{
+    assert(network.network_type_name_ == network_type_name_ && network.gpu_id_ == gpu_id_);
+    std::swap(num_input_channels_, network.num_input_channels_);
+    std::swap(input_channel_height_, network.input_channel_height_);
+    std::swap(input_channel_width_, network.input_channel_width_);
+    std::swap(num_hidden_channels_, network.num_hidden_channels_);
+    std::swap(hidden_channel_height_, network.hidden_channel_height_);
+    std::swap(hidden_channel_width_, network.hidden_channel_width_);
+    std::swap(num_blocks_, network.num_blocks_);
+    std::swap(action_size_, network.action_size_);
+    std::swap(num_value_hidden_channels_, network.num_value_hidden_channels_);
+    std::swap(discrete_value_size_, network.discrete_value_size_);
+    std::swap(game_name_, network.game_name_);
+    std::swap(network_file_name_, network.network_file_name_);
+    std::swap(network_, network.network_);
+    std::swap(tensor_output_, network.tensor_output_);
+    std::swap(cpu_inference_options_, network.cpu_inference_options_);
 }
 
 std::string Network::toString() const
@@ -58,7 +91,60 @@ std::string Network::toString() const
     oss << "Game name: " << game_name_ << std::endl;
     oss << "Network type name: " << network_type_name_ << std::endl;
     oss << "Network file name: " << network_file_name_ << std::endl;
+    if (gpu_id_ == -1) {
+        oss << "CPU optimize for inference: " << (cpu_inference_options_.optimize_for_inference_ ? "true" : "false") << std::endl;
+        oss << "CPU int8 quantization: " << (cpu_inference_options_.quantize_int8_ ? "true" : "false") << std::endl;
+        oss << "CPU intra-op threads: " << cpu_inference_options_.num_intra_op_threads_ << std::endl;
+    }
     return oss.str();
 }
 
+std::string Network::getInt8ModelFileName(const std::string& nn_file_name)
+{
+    // e.g., weight_iter_1000.pt -> weight_iter_1000_int8.pt
+    std::string::size_type extension_pos = nn_file_name.rfind(".pt");
+    if (extension_pos == std::string::npos || extension_pos + 3 != nn_file_name.size()) { return nn_file_name + "_int8"; }
+    return nn_file_name.substr(0, extension_pos) + "_int8.pt";
+}
+
+void Network::optimizeForCPUInference()
+{
+    // freezing inlines the weights and removes all methods except forward, keep the other inference methods
+    std::vector<std::string> preserved_methods;
+    for (const char* method : {"initial_inference", "recurrent_inference", "get_num_action_feature_channels"}) {
+        if (network_.find_method(method)) { preserved_methods.push_back(method); }
+    }
+    torch::jit::Module frozen_network = torch::jit::freeze(network_, preserved_methods);
+    std::vector<std::string> inference_methods;
+    for (const char* method : {"initial_inference", "recurrent_inference"}) {
+        if (frozen_network.find_method(method)) { inference_methods.push_back(method); }
+    }
+    network_ = torch::jit::optimize_for_inference(frozen_network, inference_methods);
+}
+
+std::vector<torch::Tensor> Network::transferOutputsToHost(const std::vector<torch::Tensor>& outputs)
+{
+    // outputs on CPU are already on the host
+    if (gpu_id_ == -1) {
+        std::vector<torch::Tensor> host_outputs;
+        for (const auto& output : outputs) { host_outputs.push_back(output.contiguous()); }
+        return host_outputs;
+    }
+
+    // pack all outputs into one tensor on the device and copy it back in one transfer, which is also the only synchronization of the batch
+    std::vector<torch::Tensor> flatten_outputs;
+    for (const auto& output : outputs) { flatten_outputs.push_back(output.flatten()); }
+    torch::Tensor packed_output = torch::cat(flatten_outputs);
+    if (!tensor_output_.defined() || tensor_output_.numel() < packed_output.numel() || tensor_output_.storage().use_count() > 1) { tensor_output_ = allocateHostBuffer({std::max(packed_output.numel(), (tensor_output_.defined() ? tensor_output_.numel() : 0))}); }
+    tensor_output_.narrow(0, 0, packed_output.numel()).copy_(packed_output);
+
+    std::vector<torch::Tensor> host_outputs;
+    int64_t offset = 0;
+    for (const auto& output : flatten_outputs) {
+        host_outputs.push_back(tensor_output_.narrow(0, offset, output.numel()));
+        offset += output.numel();
+    }
+    return host_outputs;
+}
+
 } // namespace minizero::network
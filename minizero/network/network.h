@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cassert>
 #include <memory>
 #include <string>
 #include <torch/script.h>
@@ -7,9 +8,64 @@
 
 namespace minizero::network {
 
+// a read-only view of a contiguous range of floats, e.g., the policy of one sample in the batch result tensor
+class OutputSpan {
+public:
+    OutputSpan() : data_(nullptr), size_(0) {}
+    OutputSpan(const float* data, size_t size) : data_(data), size_(size) {}
+
+    inline const float& operator[](size_t index) const
+    {
+        assert(index < size_);
+        return data_[index];
+    }
+    inline const float* data() const { return data_; }
+    inline const float* begin() const { return data_; }
+    inline const float* end() const { return data_ + size_; }
+    inline size_t size() const { return size_; }
+    inline bool empty() const { return size_ == 0; }
+
+private:
+    const float* data_;
+    size_t size_;
+};
+
 class NetworkOutput {
 public:
     virtual ~NetworkOutput() = default;
+
+    // copy the output into its own storage, so that it no longer keeps the batch it comes from alive
+    virtual std::shared_ptr<NetworkOutput> clone() const = 0;
+};
+
+// the outputs of one forward, each of which refers to the host result tensors owned by the batch
+// the shared pointers of the outputs share the ownership of the whole batch, so no memory is allocated per sample
+template <class Output>
+class NetworkOutputBatch {
+public:
+    std::vector<torch::Tensor> tensors_;
+    std::vector<Output> outputs_;
+
+    static std::vector<std::shared_ptr<NetworkOutput>> share(const std::shared_ptr<NetworkOutputBatch>& batch)
+    {
+        std::vector<std::shared_ptr<NetworkOutput>> network_outputs;
+        network_outputs.reserve(batch->outputs_.size());
+        for (auto& output : batch->outputs_) { network_outputs.emplace_back(batch, &output); }
+        return network_outputs;
+    }
+};
+
+// the settings of running a network on CPU, e.g., on self-play machines without GPUs
+class CPUInferenceOptions {
+public:
+    CPUInferenceOptions()
+        : optimize_for_inference_(false),
+          quantize_int8_(false),
+          num_intra_op_threads_(0) {}
+
+    bool optimize_for_inference_; // freeze the module and fuse its operators (e.g., convolution with batch norm and oneDNN layouts)
+    bool quantize_int8_;          // load the int8 model exported by the learner next to the model file, whose linear layers are dynamically quantized
+    int num_intra_op_threads_;    // the number of threads used by one forward, 0 to keep the libtorch setting
 };
 
 class Network {
@@ -18,6 +74,9 @@ public:
     virtual ~Network() = default;
 
     virtual void loadModel(const std::string& nn_file_name, const int gpu_id);
+    // take over the model of another network of the same type on the same device, e.g., a shadow network loaded on a background thread
+    // the other network gets the replaced model in exchange, so the swap costs no load and the old model is released with the other network
+    virtual void swapModel(Network& network);
     virtual std::string toString() const;
 
     inline int getGPUID() const { return gpu_id_; }
@@ -34,10 +93,27 @@ public:
     inline std::string getGameName() const { return game_name_; }
     inline std::string getNetworkTypeName() const { return network_type_name_; }
     inline std::string getNetworkFileName() const { return network_file_name_; }
+    inline void setCPUInferenceOptions(const CPUInferenceOptions& cpu_inference_options) { cpu_inference_options_ = cpu_inference_options; }
+    inline const CPUInferenceOptions& getCPUInferenceOptions() const { return cpu_inference_options_; }
+
+    static std::string getInt8ModelFileName(const std::string& nn_file_name);
 
 protected:
     inline torch::Device getDevice() const { return (gpu_id_ == -1 ? torch::Device("cpu") : torch::Device(torch::kCUDA, gpu_id_)); }
 
+    // host buffers are page-locked when running on GPU, so that the copies from and to the device can be asynchronous
+    inline torch::Tensor allocateHostBuffer(at::IntArrayRef sizes) const { return torch::empty(sizes, torch::TensorOptions().pinned_memory(gpu_id_ != -1)); }
+    // the copy is only queued on the device stream, the host buffer must not be overwritten before the outputs are transferred back
+    inline torch::Tensor copyToDevice(const torch::Tensor& host_tensor) const { return host_tensor.to(getDevice(), /*non_blocking=*/true); }
+    // the output buffer is reused only if no batch from the previous forward still refers to it
+    std::vector<torch::Tensor> transferOutputsToHost(const std::vector<torch::Tensor>& outputs);
+    // intra-op threads are set by the thread running the forward, since each CPU network may have its own core subset
+    inline void setCPUInferenceThreads() const
+    {
+        if (gpu_id_ == -1 && cpu_inference_options_.num_intra_op_threads_ > 0) { torch::set_num_threads(cpu_inference_options_.num_intra_op_threads_); }
+    }
+    void optimizeForCPUInference();
+
     int gpu_id_;
     int num_input_channels_;
     int input_channel_height_;
@@ -53,6 +129,8 @@ protected:
     std::string network_type_name_;
     std::string network_file_name_;
     torch::jit::script::Module network_;
+    torch::Tensor tensor_output_;
+    CPUInferenceOptions cpu_inference_options_;
 };
 
 } // namespace minizero::network
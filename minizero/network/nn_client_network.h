@@ -0,0 +1,166 @@
+#pragma once
+
+#include "alphazero_network.h"
+#include "nn_server_memory.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <unistd.h>
+#include <vector>
+
+namespace minizero::network {
+
+// an alphazero network whose batches are run by the nn_server on the same machine instead of a model in this process
+// the network holds one slot of the server, the inputs are written into the slot directly and the outputs are copied out of it after forward()
+class NNClientNetwork : public AlphaZeroNetwork {
+public:
+    NNClientNetwork(const std::string& nn_server_name, int max_batch_size = kDefaultMaxBatchSize)
+        : AlphaZeroNetwork(max_batch_size),
+          nn_server_name_(nn_server_name),
+          slot_id_(-1) {}
+
+    ~NNClientNetwork()
+    {
+        if (!memory_) { return; }
+        NNServerHeader& header = memory_->getHeader();
+        {
+            ScopedLock lock = memory_->lockHeader();
+            memory_->getSlot(slot_id_).state_ = NNServerSlotState::kFree;
+        }
+        header.request_cv_.notify_all(); // the server no longer waits for this slot
+    }
+
+    // request the server to load the model, which runs the batches once the server has loaded it in the background
+    // the server serves one model at a time, so the clients sharing a server should load the same model
+    void loadModel(const std::string& nn_file_name, const int gpu_id) override
+    {
+        assert(batch_size_ == 0);
+        if (!memory_) { connect(); }
+
+        NNServerHeader& header = memory_->getHeader();
+        ScopedLock lock = memory_->lockHeader();
+        if (!nn_file_name.empty()) { NNServerModelInfo::setName(header.requested_file_name_, nn_file_name); }
+        const NNServerModelInfo& model_info = header.model_info_;
+        gpu_id_ = gpu_id;
+        num_input_channels_ = model_info.num_input_channels_;
+        input_channel_height_ = model_info.input_channel_height_;
+        input_channel_width_ = model_info.input_channel_width_;
+        num_hidden_channels_ = model_info.num_hidden_channels_;
+        hidden_channel_height_ = model_info.hidden_channel_height_;
+        hidden_channel_width_ = model_info.hidden_channel_width_;
+        num_blocks_ = model_info.num_blocks_;
+        action_size_ = model_info.action_size_;
+        num_value_hidden_channels_ = model_info.num_value_hidden_channels_;
+        discrete_value_size_ = model_info.discrete_value_size_;
+        game_name_ = model_info.game_name_;
+        network_type_name_ = model_info.network_type_name_;
+        network_file_name_ = model_info.network_file_name_; // updated by forward() to the model actually running the batches
+        assert(getInputSize() == header.input_size_);
+
+        // the inputs are written into the slot of the shared memory without copies
+        // the evaluation cache is cleared by forward() once the server runs the new model
+        tensor_input_ = torch::from_blob(memory_->getSlotInput(slot_id_), {max_batch_size_, getNumInputChannels(), getInputChannelHeight(), getInputChannelWidth()});
+        clear();
+    }
+
+    std::string toString() const override
+    {
+        std::ostringstream oss;
+        oss << AlphaZeroNetwork::toString();
+        oss << "NN server: " << nn_server_name_ << " (slot " << slot_id_ << ")" << std::endl;
+        return oss.str();
+    }
+
+    std::vector<std::shared_ptr<NetworkOutput>> forward() override
+    {
+        assert(batch_size_ > 0);
+        NNServerHeader& header = memory_->getHeader();
+        {
+            ScopedLock lock = memory_->lockHeader();
+            NNServerSlot& slot = memory_->getSlot(slot_id_);
+            slot.batch_size_ = batch_size_;
+            slot.state_ = NNServerSlotState::kRequested;
+            header.request_cv_.notify_all();
+            // the wait is bounded so that the client exits instead of waiting forever for a killed or stuck server
+            const boost::posix_time::ptime deadline = boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(kResponseTimeoutSeconds);
+            while (slot.state_ != NNServerSlotState::kDone) {
+                if (!header.response_cv_.timed_wait(lock, deadline) && slot.state_ != NNServerSlotState::kDone) {
+                    std::cerr << "[nn_client] nn_server " << nn_server_name_ << " did not respond to slot " << slot_id_ << " in " << kResponseTimeoutSeconds << " seconds, the server may be killed" << std::endl;
+                    exit(-1);
+                }
+            }
+            slot.state_ = NNServerSlotState::kIdle;
+            if (network_file_name_ != slot.network_file_name_) {
+                network_file_name_ = slot.network_file_name_;
+                evaluation_cache_.clear(); // cached outputs belong to the previous model
+            }
+        }
+
+        // copy the outputs out of the slot, since the slot is overwritten by the next forward while the outputs may still be in use
+        const int policy_size = getActionSize();
+        const float* slot_output = memory_->getSlotOutput(slot_id_);
+        torch::Tensor output = torch::empty({static_cast<int64_t>(batch_size_) * (2 * policy_size + 1)});
+        std::copy(slot_output, slot_output + output.numel(), output.data_ptr<float>());
+        const float* policy_output = output.data_ptr<float>();
+        const float* policy_logits_output = policy_output + batch_size_ * policy_size;
+        const float* value_output = policy_logits_output + batch_size_ * policy_size;
+
+        auto batch = std::make_shared<NetworkOutputBatch<AlphaZeroNetworkOutput>>();
+        batch->outputs_.resize(batch_size_);
+        for (int i = 0; i < batch_size_; ++i) {
+            AlphaZeroNetworkOutput& alphazero_network_output = batch->outputs_[i];
+            alphazero_network_output.policy_ = OutputSpan(policy_output + i * policy_size, policy_size);
+            alphazero_network_output.policy_logits_ = OutputSpan(policy_logits_output + i * policy_size, policy_size);
+            alphazero_network_output.value_ = value_output[i];
+        }
+        batch->tensors_.push_back(output);
+        std::vector<std::shared_ptr<NetworkOutput>> network_outputs = NetworkOutputBatch<AlphaZeroNetworkOutput>::share(batch);
+
+        clear();
+        return network_outputs;
+    }
+
+    inline const std::string& getNNServerName() const { return nn_server_name_; }
+    inline int getSlotID() const { return slot_id_; }
+
+protected:
+    void connect()
+    {
+        // the server may still be loading its networks
+        bool is_waiting = false;
+        while (!(memory_ = NNServerMemory::open(nn_server_name_))) {
+            if (!is_waiting) { std::cerr << "[nn_client] waiting for nn_server " << nn_server_name_ << std::endl; }
+            is_waiting = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(100));
+        }
+
+        NNServerHeader& header = memory_->getHeader();
+        ScopedLock lock = memory_->lockHeader();
+        if (max_batch_size_ > header.max_batch_size_per_slot_) {
+            std::cerr << "[nn_client] the batch size " << max_batch_size_ << " exceeds the slot size " << header.max_batch_size_per_slot_ << " of nn_server " << nn_server_name_ << std::endl;
+            exit(-1);
+        }
+        for (int slot_id = 0; slot_id < header.num_slots_ && slot_id_ == -1; ++slot_id) {
+            if (memory_->getSlot(slot_id).state_ == NNServerSlotState::kFree) { slot_id_ = slot_id; }
+        }
+        if (slot_id_ == -1) {
+            std::cerr << "[nn_client] no free slot in nn_server " << nn_server_name_ << " (" << header.num_slots_ << " slots)" << std::endl;
+            exit(-1);
+        }
+        memory_->getSlot(slot_id_).state_ = NNServerSlotState::kIdle;
+        memory_->getSlot(slot_id_).owner_pid_ = getpid();
+    }
+
+    static constexpr int kResponseTimeoutSeconds = 60;
+
+    std::string nn_server_name_;
+    int slot_id_;
+    std::shared_ptr<NNServerMemory> memory_;
+};
+
+} // namespace minizero::network
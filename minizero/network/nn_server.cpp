@@ -0,0 +1,210 @@
+#include "nn_server.h"
+#include "create_network.h"
+#include <algorithm>
+#include <cassert>
+#include <chrono>
+#include <future>
+#include <iostream>
+#include <sstream>
+
+namespace minizero::network {
+
+NNServer::NNServer(const std::string& name, const std::vector<std::shared_ptr<Network>>& networks, int num_slots, int max_batch_size_per_slot, int deadline_us)
+    : deadline_(boost::posix_time::microseconds(deadline_us)),
+      stop_(false),
+      next_slot_id_(0),
+      networks_(networks),
+      num_batches_(0),
+      num_slots_(0),
+      num_positions_(0)
+{
+    assert(!networks_.empty() && deadline_us >= 0);
+    for (const auto& network : networks_) {
+        assert(network->getNetworkTypeName() == "alphazero");
+        assert(static_cast<AlphaZeroNetwork&>(*network).getMaxBatchSize() >= max_batch_size_per_slot);
+    }
+    memory_ = std::make_shared<NNServerMemory>(name, num_slots, max_batch_size_per_slot, *networks_[0]);
+    report_start_time_ = boost::posix_time::microsec_clock::universal_time();
+    for (size_t network_id = 0; network_id < networks_.size(); ++network_id) { threads_.emplace_back(&NNServer::runNetwork, this, network_id); }
+}
+
+NNServer::~NNServer()
+{
+    {
+        ScopedLock lock = memory_->lockHeader();
+        stop_ = true;
+    }
+    memory_->getHeader().request_cv_.notify_all();
+    for (auto& thread : threads_) { thread.join(); }
+}
+
+void NNServer::run(int report_interval)
+{
+    std::cerr << "[nn_server] " << getName() << " is ready, " << networks_.size() << " network(s), " << memory_->getHeader().num_slots_ << " slots" << std::endl;
+    while (true) {
+        std::this_thread::sleep_for(std::chrono::seconds(std::max(1, report_interval)));
+        if (report_interval > 0) { std::cerr << "[nn_server] " << getStatistics() << std::endl; }
+    }
+}
+
+std::string NNServer::getStatistics()
+{
+    int num_holding_slots = 0;
+    {
+        ScopedLock lock = memory_->lockHeader();
+        reclaimSlots();
+        num_holding_slots = memory_->getHeader().num_slots_ - countSlots(NNServerSlotState::kFree);
+    }
+    boost::posix_time::ptime now = boost::posix_time::microsec_clock::universal_time();
+    double seconds = std::max(1e-6, (now - report_start_time_).total_microseconds() / 1e6);
+    uint64_t num_batches = num_batches_.exchange(0);
+    uint64_t num_slots = num_slots_.exchange(0);
+    uint64_t num_positions = num_positions_.exchange(0);
+    report_start_time_ = now;
+
+    std::ostringstream oss;
+    oss << "clients: " << num_holding_slots
+        << ", batches/s: " << num_batches / seconds
+        << ", positions/s: " << num_positions / seconds
+        << ", average batch size: " << (num_batches > 0 ? static_cast<double>(num_positions) / num_batches : 0.0)
+        << ", average slots per batch: " << (num_batches > 0 ? static_cast<double>(num_slots) / num_batches : 0.0);
+    return oss.str();
+}
+
+void NNServer::runNetwork(int network_id)
+{
+    AlphaZeroNetwork& network = static_cast<AlphaZeroNetwork&>(*networks_[network_id]);
+    NNServerHeader& header = memory_->getHeader();
+    std::vector<int> slot_ids;
+    std::future<std::shared_ptr<Network>> shadow_network;
+    boost::posix_time::ptime load_start_ptime;
+    while (true) {
+        std::string requested_file_name;
+        {
+            // wait until every holding slot is requested, the requests fill a batch, or the first request has waited for the deadline
+            ScopedLock lock = memory_->lockHeader();
+            reclaimSlots();
+            boost::posix_time::ptime deadline;
+            bool is_waiting_request = true;
+            while (true) {
+                if (stop_) { return; }
+                int num_requested_positions = 0;
+                for (int slot_id = 0; slot_id < header.num_slots_; ++slot_id) {
+                    if (memory_->getSlot(slot_id).state_ == NNServerSlotState::kRequested) { num_requested_positions += memory_->getSlot(slot_id).batch_size_; }
+                }
+                if (num_requested_positions == 0) {
+                    is_waiting_request = true;
+                    header.request_cv_.wait(lock);
+                    continue;
+                }
+                if (is_waiting_request) {
+                    is_waiting_request = false;
+                    deadline = boost::posix_time::microsec_clock::universal_time() + deadline_;
+                }
+                if (countSlots(NNServerSlotState::kIdle) == 0 || num_requested_positions >= network.getMaxBatchSize() || boost::posix_time::microsec_clock::universal_time() >= deadline) { break; }
+                header.request_cv_.timed_wait(lock, deadline);
+            }
+
+            // gather the requested slots in ring order, starting after the last slot gathered
+            int batch_size = 0;
+            for (int i = 0; i < header.num_slots_; ++i) {
+                int slot_id = (next_slot_id_ + i) % header.num_slots_;
+                NNServerSlot& slot = memory_->getSlot(slot_id);
+                if (slot.state_ != NNServerSlotState::kRequested || batch_size + slot.batch_size_ > network.getMaxBatchSize()) { continue; }
+                slot.state_ = NNServerSlotState::kRunning;
+                batch_size += slot.batch_size_;
+                slot_ids.push_back(slot_id);
+            }
+            assert(!slot_ids.empty());
+            next_slot_id_ = (slot_ids.back() + 1) % header.num_slots_;
+            requested_file_name = header.requested_file_name_;
+        }
+        header.request_cv_.notify_all(); // the remaining requests may be taken by another network
+
+        // the batches keep running on the old model while the requested one is loading, a newer request is loaded after the current load is swapped in
+        if (!shadow_network.valid() && requested_file_name != network.getNetworkFileName()) {
+            std::cerr << "[nn_server] start loading model " << requested_file_name << " on GPU " << network.getGPUID() << std::endl;
+            load_start_ptime = boost::posix_time::microsec_clock::universal_time();
+            shadow_network = std::async(std::launch::async, createNetwork, requested_file_name, network.getGPUID(), network.getMaxBatchSize(), network.getCPUInferenceOptions());
+        }
+        if (shadow_network.valid() && shadow_network.wait_for(std::chrono::seconds(0)) == std::future_status::ready) {
+            swapModel(network, *shadow_network.get(), (boost::posix_time::microsec_clock::universal_time() - load_start_ptime).total_microseconds() / 1e6);
+        }
+        forward(network, slot_ids);
+        {
+            ScopedLock lock = memory_->lockHeader();
+            for (int slot_id : slot_ids) {
+                memory_->getSlot(slot_id).state_ = NNServerSlotState::kDone;
+                NNServerModelInfo::setName(memory_->getSlot(slot_id).network_file_name_, network.getNetworkFileName());
+            }
+        }
+        header.response_cv_.notify_all();
+        slot_ids.clear();
+    }
+}
+
+void NNServer::forward(AlphaZeroNetwork& network, const std::vector<int>& slot_ids)
+{
+    // the slots are running, so that no client touches them until they are done
+    const int input_size = network.getInputSize();
+    const int action_size = network.getActionSize();
+    int num_positions = 0;
+    for (int slot_id : slot_ids) {
+        const float* input = memory_->getSlotInput(slot_id);
+        for (int i = 0; i < memory_->getSlot(slot_id).batch_size_; ++i) { std::copy(input + i * input_size, input + (i + 1) * input_size, network.allocateInput().second); }
+        num_positions += memory_->getSlot(slot_id).batch_size_;
+    }
+    std::vector<std::shared_ptr<NetworkOutput>> outputs = network.forward();
+    assert(static_cast<int>(outputs.size()) == num_positions);
+
+    int index = 0;
+    for (int slot_id : slot_ids) {
+        float* output = memory_->getSlotOutput(slot_id);
+        const int batch_size = memory_->getSlot(slot_id).batch_size_;
+        for (int i = 0; i < batch_size; ++i) {
+            const AlphaZeroNetworkOutput& alphazero_output = static_cast<const AlphaZeroNetworkOutput&>(*outputs[index++]);
+            std::copy(alphazero_output.policy_.begin(), alphazero_output.policy_.end(), output + i * action_size);
+            std::copy(alphazero_output.policy_logits_.begin(), alphazero_output.policy_logits_.end(), output + (batch_size + i) * action_size);
+            output[2 * batch_size * action_size + i] = alphazero_output.value_;
+        }
+    }
+    ++num_batches_;
+    num_slots_ += slot_ids.size();
+    num_positions_ += num_positions;
+}
+
+void NNServer::swapModel(AlphaZeroNetwork& network, Network& shadow_network, float load_seconds)
+{
+    // the slot layout is fixed, so the model can only be replaced by one of the same input and action sizes
+    NNServerHeader& header = memory_->getHeader();
+    assert(static_cast<AlphaZeroNetwork&>(shadow_network).getInputSize() == header.input_size_ && 2 * shadow_network.getActionSize() + 1 == header.output_size_);
+    boost::posix_time::ptime start_ptime = boost::posix_time::microsec_clock::universal_time();
+    network.swapModel(shadow_network);
+    {
+        ScopedLock lock = memory_->lockHeader();
+        header.model_info_.set(network);
+    }
+    float stall_ms = (boost::posix_time::microsec_clock::universal_time() - start_ptime).total_microseconds() / 1000.0f;
+    std::cerr << "[nn_server] swap in model " << network.getNetworkFileName() << " on GPU " << network.getGPUID()
+              << ", loaded in background: " << load_seconds << " s, stall: " << stall_ms << " ms" << std::endl;
+}
+
+void NNServer::reclaimSlots()
+{
+    // a killed client may hold a slot in any state, e.g., an idle slot would make every batch wait for the deadline
+    for (int slot_id = 0; slot_id < memory_->getHeader().num_slots_; ++slot_id) {
+        NNServerSlot& slot = memory_->getSlot(slot_id);
+        if (slot.state_ == NNServerSlotState::kRunning || !slot.isOwnerDead()) { continue; }
+        std::cerr << "[nn_server] reclaim slot " << slot_id << " of killed process " << slot.owner_pid_ << std::endl;
+        slot.state_ = NNServerSlotState::kFree;
+    }
+}
+
+int NNServer::countSlots(NNServerSlotState state)
+{
+    int count = 0;
+    for (int slot_id = 0; slot_id < memory_->getHeader().num_slots_; ++slot_id) { count += (memory_->getSlot(slot_id).state_ == state); }
+    return count;
+}
+
+} // namespace minizero::network
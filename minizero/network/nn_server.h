@@ -0,0 +1,51 @@
+#pragma once
+
+#include "alphazero_network.h"
+#include "nn_server_memory.h"
+#include <atomic>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+namespace minizero::network {
+
+// the server owning the networks shared by the self-play processes on the same machine
+// each network (e.g., one per GPU) is served by its own thread, which gathers the requested slots of all clients into one batch,
+// runs it once every holding slot is requested or the first request has waited for the deadline, and writes the outputs back into the slots
+// a model requested by the clients is loaded into a shadow network in the background and swapped in between batches
+class NNServer {
+public:
+    NNServer(const std::string& name, const std::vector<std::shared_ptr<Network>>& networks, int num_slots, int max_batch_size_per_slot, int deadline_us);
+    ~NNServer();
+
+    // serve forever, reporting the statistics every report_interval seconds (0 to disable)
+    void run(int report_interval);
+
+    std::string getStatistics();
+    inline const std::string& getName() const { return memory_->getName(); }
+
+private:
+    void runNetwork(int network_id);
+    void forward(AlphaZeroNetwork& network, const std::vector<int>& slot_ids);
+    void swapModel(AlphaZeroNetwork& network, Network& shadow_network, float load_seconds);
+    void reclaimSlots();
+    int countSlots(NNServerSlotState state);
+
+    boost::posix_time::time_duration deadline_;
+    bool stop_; // guarded by the mutex in the header
+    int next_slot_id_; // the slot to gather first, rotated for fairness among clients; guarded by the mutex in the header
+    std::vector<std::shared_ptr<Network>> networks_;
+    std::shared_ptr<NNServerMemory> memory_;
+    std::vector<std::thread> threads_;
+
+    // statistics
+    boost::posix_time::ptime report_start_time_;
+    std::atomic<uint64_t> num_batches_;
+    std::atomic<uint64_t> num_slots_;
+    std::atomic<uint64_t> num_positions_;
+};
+
+} // namespace minizero::network
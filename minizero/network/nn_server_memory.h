@@ -0,0 +1,209 @@
+#pragma once
+
+#include "network.h"
+#include <atomic>
+#include <boost/date_time/posix_time/posix_time.hpp>
+#include <boost/interprocess/mapped_region.hpp>
+#include <boost/interprocess/shared_memory_object.hpp>
+#include <boost/interprocess/sync/interprocess_condition.hpp>
+#include <boost/interprocess/sync/interprocess_mutex.hpp>
+#include <boost/interprocess/sync/scoped_lock.hpp>
+#include <cassert>
+#include <cerrno>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <memory>
+#include <new>
+#include <string>
+#include <sys/types.h>
+
+namespace minizero::network {
+
+typedef boost::interprocess::scoped_lock<boost::interprocess::interprocess_mutex> ScopedLock;
+
+enum class NNServerSlotState {
+    kFree,      // not held by any client network
+    kIdle,      // held by a client network, which is preparing its next batch
+    kRequested, // the batch is written into the slot and waits for the server
+    kRunning,   // the batch is being run by the server
+    kDone       // the outputs are written into the slot and wait for the client
+};
+
+// the network hyper-parameters of the model loaded by the server, which are what client networks report
+class NNServerModelInfo {
+public:
+    static constexpr int kMaxNameLength = 256;
+
+    void set(const Network& network)
+    {
+        num_input_channels_ = network.getNumInputChannels();
+        input_channel_height_ = network.getInputChannelHeight();
+        input_channel_width_ = network.getInputChannelWidth();
+        num_hidden_channels_ = network.getNumHiddenChannels();
+        hidden_channel_height_ = network.getHiddenChannelHeight();
+        hidden_channel_width_ = network.getHiddenChannelWidth();
+        num_blocks_ = network.getNumBlocks();
+        action_size_ = network.getActionSize();
+        num_value_hidden_channels_ = network.getNumValueHiddenChannels();
+        discrete_value_size_ = network.getDiscreteValueSize();
+        setName(game_name_, network.getGameName());
+        setName(network_type_name_, network.getNetworkTypeName());
+        setName(network_file_name_, network.getNetworkFileName());
+    }
+
+    static inline void setName(char* dst, const std::string& name)
+    {
+        assert(name.size() < kMaxNameLength);
+        std::strncpy(dst, name.c_str(), kMaxNameLength - 1);
+        dst[kMaxNameLength - 1] = '\0';
+    }
+
+    int num_input_channels_;
+    int input_channel_height_;
+    int input_channel_width_;
+    int num_hidden_channels_;
+    int hidden_channel_height_;
+    int hidden_channel_width_;
+    int num_blocks_;
+    int action_size_;
+    int num_value_hidden_channels_;
+    int discrete_value_size_;
+    char game_name_[kMaxNameLength];
+    char network_type_name_[kMaxNameLength];
+    char network_file_name_[kMaxNameLength];
+};
+
+class NNServerSlot {
+public:
+    // the slot of a killed client is never freed by the client itself, so it is reclaimed by the server
+    inline bool isOwnerDead() const { return state_ != NNServerSlotState::kFree && kill(owner_pid_, 0) == -1 && errno == ESRCH; }
+
+    NNServerSlotState state_;
+    pid_t owner_pid_; // the process holding the slot
+    int batch_size_;
+    char network_file_name_[NNServerModelInfo::kMaxNameLength]; // the model that ran the last batch of the slot
+};
+
+class NNServerHeader {
+public:
+    boost::interprocess::interprocess_mutex mutex_;           // guards everything below except is_ready_
+    boost::interprocess::interprocess_condition request_cv_;  // notified by clients when a slot is requested
+    boost::interprocess::interprocess_condition response_cv_; // notified by the server when slots are done
+    std::atomic<bool> is_ready_;                              // set by the server once the whole memory is initialized
+    int num_slots_;
+    int max_batch_size_per_slot_;
+    int input_size_;  // the number of floats of one sample input
+    int output_size_; // the number of floats of one sample output, i.e., policy, policy logits, and value
+    NNServerModelInfo model_info_;
+    char requested_file_name_[NNServerModelInfo::kMaxNameLength]; // the model requested by the clients, loaded by the server in the background and swapped in between batches
+};
+
+// the shared memory between an nn_server and the self-play processes on the same machine, which consists of
+// [header][slot 0 ... slot n-1][inputs of slot 0 ... inputs of slot n-1][outputs of slot 0 ... outputs of slot n-1]
+// a slot is a fixed region of request and response of one client network, its outputs are stored as
+// [policy of all samples][policy logits of all samples][value of all samples]
+class NNServerMemory {
+public:
+    // create the memory by the server, any stale memory of the same name (e.g., from a killed server) is removed
+    NNServerMemory(const std::string& name, int num_slots, int max_batch_size_per_slot, const Network& network)
+        : name_(name), is_owner_(true)
+    {
+        assert(num_slots > 0 && max_batch_size_per_slot > 0);
+        boost::interprocess::shared_memory_object::remove(name_.c_str());
+        int input_size = network.getNumInputChannels() * network.getInputChannelHeight() * network.getInputChannelWidth();
+        int output_size = 2 * network.getActionSize() + 1;
+        shared_memory_ = boost::interprocess::shared_memory_object(boost::interprocess::create_only, name_.c_str(), boost::interprocess::read_write);
+        shared_memory_.truncate(calculateSize(num_slots, max_batch_size_per_slot, input_size, output_size));
+        region_ = boost::interprocess::mapped_region(shared_memory_, boost::interprocess::read_write);
+
+        NNServerHeader* header = new (region_.get_address()) NNServerHeader();
+        header->is_ready_ = false;
+        header->num_slots_ = num_slots;
+        header->max_batch_size_per_slot_ = max_batch_size_per_slot;
+        header->input_size_ = input_size;
+        header->output_size_ = output_size;
+        header->model_info_.set(network);
+        NNServerModelInfo::setName(header->requested_file_name_, network.getNetworkFileName());
+        for (int slot_id = 0; slot_id < num_slots; ++slot_id) {
+            getSlot(slot_id).state_ = NNServerSlotState::kFree;
+            getSlot(slot_id).owner_pid_ = 0;
+            getSlot(slot_id).batch_size_ = 0;
+            NNServerModelInfo::setName(getSlot(slot_id).network_file_name_, network.getNetworkFileName());
+        }
+        header->is_ready_ = true;
+    }
+
+    // open the memory by a client, returns nullptr if the server is not ready
+    static std::shared_ptr<NNServerMemory> open(const std::string& name)
+    {
+        std::shared_ptr<NNServerMemory> memory(new NNServerMemory(name));
+        try {
+            memory->shared_memory_ = boost::interprocess::shared_memory_object(boost::interprocess::open_only, name.c_str(), boost::interprocess::read_write);
+            boost::interprocess::offset_t size = 0;
+            if (!memory->shared_memory_.get_size(size) || size < static_cast<boost::interprocess::offset_t>(sizeof(NNServerHeader))) { return nullptr; }
+            memory->region_ = boost::interprocess::mapped_region(memory->shared_memory_, boost::interprocess::read_write);
+        } catch (const boost::interprocess::interprocess_exception&) {
+            return nullptr;
+        }
+        return (memory->getHeader().is_ready_ ? memory : nullptr);
+    }
+
+    ~NNServerMemory()
+    {
+        if (is_owner_) { boost::interprocess::shared_memory_object::remove(name_.c_str()); }
+    }
+
+    // lock the mutex of the header, which is never released if a process is killed while holding it
+    // the wait is bounded so that the processes exit instead of blocking each other forever
+    ScopedLock lockHeader()
+    {
+        ScopedLock lock(getHeader().mutex_, boost::posix_time::microsec_clock::universal_time() + boost::posix_time::seconds(kLockTimeoutSeconds));
+        if (!lock.owns()) {
+            std::cerr << "[nn_server] failed to lock " << name_ << " in " << kLockTimeoutSeconds << " seconds, the lock may be held by a killed process" << std::endl;
+            exit(-1);
+        }
+        return lock;
+    }
+
+    inline NNServerHeader& getHeader() { return *static_cast<NNServerHeader*>(region_.get_address()); }
+    inline NNServerSlot& getSlot(int slot_id)
+    {
+        assert(slot_id >= 0 && slot_id < getHeader().num_slots_);
+        return reinterpret_cast<NNServerSlot*>(getAddress(kSlotOffset))[slot_id];
+    }
+    inline float* getSlotInput(int slot_id)
+    {
+        const NNServerHeader& header = getHeader();
+        size_t offset = getInputOffset(header.num_slots_) + static_cast<size_t>(slot_id) * header.max_batch_size_per_slot_ * header.input_size_ * sizeof(float);
+        return reinterpret_cast<float*>(getAddress(offset));
+    }
+    inline float* getSlotOutput(int slot_id)
+    {
+        const NNServerHeader& header = getHeader();
+        size_t offset = getOutputOffset(header.num_slots_, header.max_batch_size_per_slot_, header.input_size_) + static_cast<size_t>(slot_id) * header.max_batch_size_per_slot_ * header.output_size_ * sizeof(float);
+        return reinterpret_cast<float*>(getAddress(offset));
+    }
+    inline const std::string& getName() const { return name_; }
+
+private:
+    explicit NNServerMemory(const std::string& name) : name_(name), is_owner_(false) {}
+
+    static constexpr int kLockTimeoutSeconds = 10;
+    static constexpr size_t kAlignment = 64;
+    static constexpr size_t kSlotOffset = (sizeof(NNServerHeader) + kAlignment - 1) / kAlignment * kAlignment;
+
+    static inline size_t align(size_t offset) { return (offset + kAlignment - 1) / kAlignment * kAlignment; }
+    static inline size_t getInputOffset(int num_slots) { return align(kSlotOffset + num_slots * sizeof(NNServerSlot)); }
+    static inline size_t getOutputOffset(int num_slots, int max_batch_size_per_slot, int input_size) { return align(getInputOffset(num_slots) + static_cast<size_t>(num_slots) * max_batch_size_per_slot * input_size * sizeof(float)); }
+    static inline size_t calculateSize(int num_slots, int max_batch_size_per_slot, int input_size, int output_size) { return getOutputOffset(num_slots, max_batch_size_per_slot, input_size) + static_cast<size_t>(num_slots) * max_batch_size_per_slot * output_size * sizeof(float); }
+    inline char* getAddress(size_t offset) { return static_cast<char*>(region_.get_address()) + offset; }
+
+    std::string name_;
+    bool is_owner_;
+    boost::interprocess::shared_memory_object shared_memory_;
+    boost::interprocess::mapped_region region_;
+};
+
+} // namespace minizero::network
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+
+namespace minizero::utils {
+
+// conversion between float and IEEE 754 half precision (round to nearest even), for storing values at reduced precision
+inline uint16_t floatToHalf(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint16_t half;
+    if (bits >= 0x47800000u) { // overflow, infinity, or NaN
+        half = (bits > 0x7f800000u ? 0x7e00 : 0x7c00);
+    } else if (bits < 0x38800000u) { // subnormal or zero, let the float addition do the rounding
+        float magic = 0.5f, rounded;
+        std::memcpy(&rounded, &bits, sizeof(bits));
+        rounded += magic;
+        std::memcpy(&bits, &rounded, sizeof(bits));
+        half = bits - 0x3f000000u;
+    } else {
+        uint32_t odd_mantissa = (bits >> 13) & 1;
+        bits += (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + odd_mantissa;
+        half = bits >> 13;
+    }
+    return half | (sign >> 16);
+}
+
+// the largest finite half precision value
+constexpr float kMaxHalf = 65504.0f;
+
+// values beyond the half range saturate to the largest finite half instead of overflowing to infinity
+inline uint16_t floatToSaturatedHalf(float value) { return floatToHalf(std::max(-kMaxHalf, std::min(value, kMaxHalf))); }
+
+inline float halfToFloat(uint16_t half)
+{
+    const uint32_t shifted_exponent = 0x7c00u << 13;
+    uint32_t bits = (half & 0x7fffu) << 13;
+    uint32_t exponent = bits & shifted_exponent;
+    bits += static_cast<uint32_t>(127 - 15) << 23;
+    float value;
+    if (exponent == shifted_exponent) { // infinity or NaN
+        bits += static_cast<uint32_t>(128 - 16) << 23;
+        std::memcpy(&value, &bits, sizeof(bits));
+    } else if (exponent == 0) { // subnormal or zero, renormalize
+        bits += 1u << 23;
+        std::memcpy(&value, &bits, sizeof(bits));
+        value -= 6.103515625e-05f; // 2^-14
+    } else {
+        std::memcpy(&value, &bits, sizeof(bits));
+    }
+    uint32_t sign = static_cast<uint32_t>(half & 0x8000u) << 16;
+    std::memcpy(&bits, &value, sizeof(bits));
+    bits |= sign;
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+// conversion between float and bfloat16 (the upper half of a float, round to nearest even)
+inline uint16_t floatToBFloat16(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    if ((bits & 0x7fffffffu) > 0x7f800000u) { return (bits >> 16) | 0x0040; } // keep NaN quiet
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return bits >> 16;
+}
+
+inline float bfloat16ToFloat(uint16_t bfloat16)
+{
+    uint32_t bits = static_cast<uint32_t>(bfloat16) << 16;
+    float value;
+    std::memcpy(&value, &bits, sizeof(bits));
+    return value;
+}
+
+} // namespace minizero::utils
@@ -9,6 +9,7 @@ namespace minizero::utils {
 class Random {
 public:
     static inline void seed(int seed) { generator_.seed(seed); }
+    static inline void seed(std::seed_seq& seed_sequence) { generator_.seed(seed_sequence); }
     static inline int randInt() { return int_distribution_(generator_); }
     static inline double randReal(double range = 1.0f) { return real_distribution_(generator_) * range; }
 
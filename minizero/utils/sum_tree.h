@@ -0,0 +1,63 @@
+#pragma once
+
+#include <algorithm>
+#include <cassert>
+#include <vector>
+
+namespace minizero::utils {
+
+// a binary indexed sum tree over non-negative priorities, supporting O(log N) update and proportional sampling
+class SumTree {
+public:
+    SumTree(int capacity = 0) { reset(capacity); }
+
+    inline void reset(int capacity)
+    {
+        assert(capacity >= 0);
+        capacity_ = capacity;
+        num_leaves_ = 1;
+        while (num_leaves_ < capacity_) { num_leaves_ <<= 1; }
+        tree_.assign(2 * num_leaves_, 0.0f);
+    }
+
+    inline void update(int index, float priority)
+    {
+        assert(index >= 0 && index < capacity_ && priority >= 0.0f);
+        int node = num_leaves_ + index;
+        tree_[node] = priority;
+        for (node >>= 1; node >= 1; node >>= 1) { tree_[node] = tree_[2 * node] + tree_[2 * node + 1]; }
+    }
+
+    // find the index whose prefix sum interval contains value, where value is in [0, getSum())
+    inline int sample(float value) const
+    {
+        assert(getSum() > 0.0f);
+        int node = 1;
+        while (node < num_leaves_) {
+            const float left_sum = tree_[2 * node];
+            // go left when value falls in the left subtree or when rounding error points to an empty right subtree
+            if (value < left_sum || tree_[2 * node + 1] <= 0.0f) {
+                node = 2 * node;
+            } else {
+                value -= left_sum;
+                node = 2 * node + 1;
+            }
+        }
+        return std::min(node - num_leaves_, capacity_ - 1);
+    }
+
+    inline float get(int index) const
+    {
+        assert(index >= 0 && index < capacity_);
+        return tree_[num_leaves_ + index];
+    }
+    inline float getSum() const { return tree_[1]; }
+    inline int getCapacity() const { return capacity_; }
+
+private:
+    int capacity_;
+    int num_leaves_;
+    std::vector<float> tree_;
+};
+
+} // namespace minizero::utils